@@ -30,6 +30,9 @@
 
 #include "config.h"
 #include "live/livequeue.h"
+#include "live/livedemuxer.h"
+#include "live/pretuner.h"
+#include "robotv/StreamPacketAggregator.h"
 
 RoboTVServerConfig::RoboTVServerConfig() : listenPort(LISTEN_PORT) {
 }
@@ -47,6 +50,9 @@ void RoboTVServerConfig::Load() {
         }
     }
 
+    // settings depending on each other (in any order)
+    StreamPacketAggregator::checkPacketSizes();
+
     LiveQueue::removeTimeShiftFiles();
 }
 
@@ -57,6 +63,36 @@ bool RoboTVServerConfig::Parse(const char* Name, const char* Value) {
     else if(!strcasecmp(Name, "MaxTimeShiftSize")) {
         LiveQueue::setBufferSize(strtoull(Value, NULL, 10));
     }
+    else if(!strcasecmp(Name, "MaxTimeShiftTotalSize")) {
+        LiveQueue::setTotalBufferSize(strtoull(Value, NULL, 10));
+    }
+    else if(!strcasecmp(Name, "MaxTimeShiftTime")) {
+        LiveQueue::setMaxBufferTime(atoi(Value));
+    }
+    else if(!strcasecmp(Name, "TimeShiftMode")) {
+        LiveQueue::setStorageMode(!strcasecmp(Value, "mmap") ? LiveQueue::StorageMode::MMAP : LiveQueue::StorageMode::FILE);
+    }
+    else if(!strcasecmp(Name, "TimeShiftLiveCacheSize")) {
+        LiveQueue::setLiveCacheSize(strtoull(Value, NULL, 10));
+    }
+    else if(!strcasecmp(Name, "TimeShiftFilePool")) {
+        LiveQueue::setFilePoolSize(atoi(Value));
+    }
+    else if(!strcasecmp(Name, "GopCacheSize")) {
+        LiveDemuxer::setGopCacheSize(strtoul(Value, NULL, 10));
+    }
+    else if(!strcasecmp(Name, "PreTuneChannels")) {
+        PreTuner::instance().setChannelCount(atoi(Value));
+    }
+    else if(!strcasecmp(Name, "StreamLatency")) {
+        StreamPacketAggregator::setDefaultLatency(atoi(Value));
+    }
+    else if(!strcasecmp(Name, "StreamPacketMinSize")) {
+        StreamPacketAggregator::setMinPacketSize(strtoul(Value, NULL, 10));
+    }
+    else if(!strcasecmp(Name, "StreamPacketMaxSize")) {
+        StreamPacketAggregator::setMaxPacketSize(strtoul(Value, NULL, 10));
+    }
     else if(!strcasecmp(Name, "PiconsURL")) {
         piconsUrl = Value;
     }
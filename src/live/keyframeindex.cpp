@@ -0,0 +1,138 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include "keyframeindex.h"
+
+KeyFrameIndex::KeyFrameIndex() : m_entries(initialCapacity), m_head(0), m_count(0) {
+}
+
+void KeyFrameIndex::push_back(Entry entry) {
+    if(m_count == m_entries.size()) {
+        grow();
+    }
+
+    // keep the index sorted (wallclock may jump backwards)
+    if(m_count > 0 && entry.wallclockTime < back().wallclockTime) {
+        entry.wallclockTime = back().wallclockTime;
+    }
+
+    m_entries[(m_head + m_count) & (m_entries.size() - 1)] = entry;
+    m_count++;
+}
+
+void KeyFrameIndex::pop_front() {
+    if(m_count == 0) {
+        return;
+    }
+
+    m_head = (m_head + 1) & (m_entries.size() - 1);
+    m_count--;
+}
+
+void KeyFrameIndex::pop_back() {
+    if(m_count == 0) {
+        return;
+    }
+
+    m_count--;
+}
+
+void KeyFrameIndex::clear() {
+    m_head = 0;
+    m_count = 0;
+}
+
+void KeyFrameIndex::grow() {
+    // capacity stays a power of two
+    std::vector<Entry> entries(m_entries.size() * 2);
+
+    for(size_t i = 0; i < m_count; i++) {
+        entries[i] = (*this)[i];
+    }
+
+    m_entries.swap(entries);
+    m_head = 0;
+}
+
+size_t KeyFrameIndex::findTime(int64_t wallclockTimeMs) const {
+    // first entry after the given time
+    size_t first = 0;
+    size_t count = m_count;
+
+    while(count > 0) {
+        size_t step = count / 2;
+        size_t i = first + step;
+
+        if((*this)[i].wallclockTime.count() <= wallclockTimeMs) {
+            first = i + 1;
+            count -= step + 1;
+        }
+        else {
+            count = step;
+        }
+    }
+
+    return (first == 0) ? 0 : first - 1;
+}
+
+size_t KeyFrameIndex::findPosition(int wrapCount, off_t position) const {
+    // first entry at or after (wrapCount, position)
+    size_t first = 0;
+    size_t count = m_count;
+
+    while(count > 0) {
+        size_t step = count / 2;
+        size_t i = first + step;
+        const Entry& e = (*this)[i];
+
+        if(e.wrapCount < wrapCount || (e.wrapCount == wrapCount && e.filePosition < position)) {
+            first = i + 1;
+            count -= step + 1;
+        }
+        else {
+            count = step;
+        }
+    }
+
+    return first;
+}
+
+void KeyFrameIndex::trim(int wrapCount, off_t position) {
+    while(m_count > 0) {
+        const Entry& e = front();
+
+        // leftovers of older laps (behind the last wrap position)
+        bool outdated = (e.wrapCount < wrapCount - 1);
+
+        // overwritten by the current lap
+        bool overwritten = (e.wrapCount < wrapCount && e.filePosition < position);
+
+        if(!outdated && !overwritten) {
+            break;
+        }
+
+        pop_front();
+    }
+}
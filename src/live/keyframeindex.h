@@ -0,0 +1,124 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_KEYFRAMEINDEX_H
+#define ROBOTV_KEYFRAMEINDEX_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <chrono>
+#include <vector>
+
+/**
+ * Keyframe index of the timeshift ringbuffer.
+ * Flat ring array of keyframe positions ordered by write order (and therefore
+ * by wallclock time). Lookups are done with a binary search, so seeking takes
+ * the same time regardless of the amount of buffered data.
+ */
+class KeyFrameIndex {
+public:
+
+    struct Entry {
+        off_t filePosition;
+        std::chrono::milliseconds wallclockTime;
+        int64_t pts;
+        int wrapCount;
+    };
+
+    KeyFrameIndex();
+
+    /**
+     * Append a keyframe.
+     * Entries must be added in write order. The wallclock time is clamped to
+     * the time of the previous entry to keep the index sorted.
+     * @param entry keyframe to add
+     */
+    void push_back(Entry entry);
+
+    void pop_front();
+
+    void pop_back();
+
+    void clear();
+
+    inline bool empty() const {
+        return m_count == 0;
+    }
+
+    inline size_t size() const {
+        return m_count;
+    }
+
+    inline const Entry& operator[](size_t index) const {
+        return m_entries[(m_head + index) & (m_entries.size() - 1)];
+    }
+
+    inline const Entry& front() const {
+        return (*this)[0];
+    }
+
+    inline const Entry& back() const {
+        return (*this)[m_count - 1];
+    }
+
+    /**
+     * Find a keyframe by wallclock time.
+     * @param wallclockTimeMs wallclock time in milliseconds
+     * @return index of the last keyframe at or before the given time (0 if the time is before the first keyframe)
+     */
+    size_t findTime(int64_t wallclockTimeMs) const;
+
+    /**
+     * Find a keyframe by ringbuffer position.
+     * @param wrapCount lap of the ringbuffer
+     * @param position position within the lap
+     * @return index of the first keyframe at or after the given position (size() if there is none)
+     */
+    size_t findPosition(int wrapCount, off_t position) const;
+
+    /**
+     * Remove overwritten keyframes.
+     * Drops all keyframes of previous laps that are overwritten by the writer
+     * when it writes up to the given position.
+     * @param wrapCount current lap of the writer
+     * @param position end position of the data written in this lap
+     */
+    void trim(int wrapCount, off_t position);
+
+private:
+
+    void grow();
+
+    std::vector<Entry> m_entries;
+
+    size_t m_head;
+
+    size_t m_count;
+
+    static const size_t initialCapacity = 1024;
+};
+
+#endif // ROBOTV_KEYFRAMEINDEX_H
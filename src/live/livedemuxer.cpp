@@ -0,0 +1,909 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <algorithm>
+
+#include "net/msgpacket.h"
+#include "robotv/robotvcommand.h"
+#include "tools/hash.h"
+#include "tools/time.h"
+
+#include "livedemuxer.h"
+#include "channelcache.h"
+
+using namespace std::chrono;
+
+std::map<uint32_t, LiveDemuxer*> LiveDemuxer::m_demuxers;
+std::mutex LiveDemuxer::m_mutexDemuxers;
+std::condition_variable LiveDemuxer::m_tuneCondition;
+size_t LiveDemuxer::m_gopCacheSize = 8 * 1024 * 1024;
+bool LiveDemuxer::m_keepReceiving = false;
+std::atomic<uint64_t> LiveDemuxer::m_tuneCount(0);
+std::atomic<uint64_t> LiveDemuxer::m_sharedTuneCount(0);
+
+static std::set<int> mergePids(const std::set<int>& a, const std::set<int>& b) {
+    // empty sets select all streams
+    if(a.empty() || b.empty()) {
+        return std::set<int>();
+    }
+
+    std::set<int> result(a);
+    result.insert(b.begin(), b.end());
+
+    return result;
+}
+
+static bool wantsPid(const std::set<int>& pids, int pid) {
+    return pids.empty() || pids.count(pid) > 0;
+}
+
+// stream packets start with the pid of the stream
+static int packetPid(MsgPacket* p) {
+    uint8_t* payload = p->getPayload();
+    return (payload[0] << 8) | payload[1];
+}
+
+LiveDemuxer::LiveDemuxer(uint32_t uid, int priority)
+    : cReceiver(nullptr, priority)
+    , m_uid(uid)
+    , m_demuxRunning(true) {
+    m_demuxThread = new std::thread(&LiveDemuxer::demuxLoop, this);
+}
+
+LiveDemuxer::~LiveDemuxer() {
+    cDevice * device = Device();
+
+    if(device != nullptr) {
+        cCamSlot *camSlot = device->CamSlot();
+
+        if (camSlot != nullptr) {
+            isyslog("camslot detached");
+            ChannelCamRelations.ClrChecked(ChannelID(), camSlot->SlotNumber());
+        }
+
+        Detach();
+    }
+
+    // stop demuxing
+    {
+        std::lock_guard<std::mutex> lock(m_wakeupMutex);
+        m_demuxRunning = false;
+    }
+
+    m_demuxCondition.notify_one();
+    m_demuxThread->join();
+    delete m_demuxThread;
+
+    isyslog("TS ring: max %lu of %lu packets used, %lu packets dropped",
+        m_ring.maxSize(), m_ring.capacity(), m_ring.overflowCount());
+
+    reset();
+    clearGopCache();
+
+    isyslog("live demuxer %08x terminated", m_uid);
+}
+
+LiveDemuxer* LiveDemuxer::subscribe(
+    const cChannel* channel,
+    int priority,
+    LiveQueue* queue,
+    LiveQueue::Reader* reader,
+    const std::string& language,
+    StreamInfo::Type streamType,
+    const std::set<int>& pids,
+    int& status) {
+
+    if(channel == nullptr) {
+        esyslog("unknown channel !");
+        status = ROBOTV_RET_ERROR;
+        return nullptr;
+    }
+
+    uint32_t uid = createChannelUid(channel);
+
+    std::unique_lock<std::mutex> lock(m_mutexDemuxers);
+    LiveDemuxer* demuxer = waitForTuning(lock, uid);
+
+    // first client of the channel
+    if(demuxer == nullptr) {
+        demuxer = new LiveDemuxer(uid, priority);
+        demuxer->m_pids = pids;
+        m_demuxers[uid] = demuxer;
+
+        status = demuxer->tune(lock, channel, LIVEPRIORITY);
+
+        if(status != ROBOTV_RET_OK) {
+            m_demuxers.erase(uid);
+            lock.unlock();
+
+            delete demuxer;
+            return nullptr;
+        }
+    }
+    // channel is already received
+    else {
+        if(priority > demuxer->Priority()) {
+            demuxer->SetPriority(priority);
+        }
+
+        // the receiver may have been detached (device needed for a recording)
+        if(!demuxer->IsAttached()) {
+            isyslog("receiver of channel %i - %s detached - switching again", channel->Number(), channel->Name());
+
+            {
+                std::lock_guard<std::mutex> lockDemux(demuxer->m_demuxMutex);
+                demuxer->m_pids = mergePids(demuxer->getWantedPids(), pids);
+            }
+
+            status = demuxer->tune(lock, channel, LIVEPRIORITY);
+
+            if(status != ROBOTV_RET_OK) {
+                // nobody uses the demuxer anymore (pre-tuned channels are released by the pre-tuner)
+                if(demuxer->m_subscribers.empty() && !demuxer->m_preTuned) {
+                    m_demuxers.erase(uid);
+                    lock.unlock();
+
+                    delete demuxer;
+                }
+
+                return nullptr;
+            }
+        }
+    }
+
+    size_t count = 0;
+
+    {
+        std::lock_guard<std::mutex> lockDemux(demuxer->m_demuxMutex);
+        demuxer->m_subscribers.push_back({queue, reader, priority, language, streamType, pids, false});
+        count = demuxer->m_subscribers.size();
+    }
+
+    // demux the streams added by the client
+    // (other clients can't tune the channel meanwhile)
+    std::set<int> wanted = demuxer->getWantedPids();
+
+    if(demuxer->needsPids(wanted)) {
+        demuxer->m_tuning = true;
+        lock.unlock();
+
+        demuxer->updatePids(wanted);
+
+        lock.lock();
+        demuxer->m_tuning = false;
+        m_tuneCondition.notify_all();
+    }
+
+    isyslog("client %i subscribed to channel %i - %s (%lu clients)", reader->socket, channel->Number(), channel->Name(), count);
+
+    status = ROBOTV_RET_OK;
+    return demuxer;
+}
+
+LiveDemuxer* LiveDemuxer::waitForTuning(std::unique_lock<std::mutex>& lock, uint32_t uid) {
+    for(;;) {
+        auto i = m_demuxers.find(uid);
+
+        if(i == m_demuxers.end()) {
+            return nullptr;
+        }
+
+        if(!i->second->m_tuning) {
+            return i->second;
+        }
+
+        m_tuneCondition.wait(lock);
+    }
+}
+
+int LiveDemuxer::tune(std::unique_lock<std::mutex>& lock, const cChannel* channel, int priority) {
+    m_tuning = true;
+    lock.unlock();
+
+    int status = switchChannel(channel, priority);
+
+    lock.lock();
+    m_tuning = false;
+    m_tuneCondition.notify_all();
+
+    return status;
+}
+
+void LiveDemuxer::unsubscribe(LiveDemuxer* demuxer, LiveQueue::Reader* reader) {
+    if(demuxer == nullptr || reader == nullptr) {
+        return;
+    }
+
+    bool last = false;
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutexDemuxers);
+        int priority = MINPRIORITY;
+
+        // the demuxer can't be destroyed while it is tuned
+        m_tuneCondition.wait(lock, [&]() {
+            return !demuxer->m_tuning;
+        });
+
+        {
+            std::lock_guard<std::mutex> lockDemux(demuxer->m_demuxMutex);
+
+            demuxer->m_subscribers.remove_if([&](const Subscriber& s) {
+                return s.reader == reader;
+            });
+
+            for(const auto& s : demuxer->m_subscribers) {
+                priority = std::max(priority, s.priority);
+            }
+
+            last = demuxer->m_subscribers.empty();
+        }
+
+        isyslog("client %i unsubscribed from channel %08x", reader->socket, demuxer->m_uid);
+
+        // keep the channel for the pre-tuner
+        if(last && m_keepReceiving && demuxer->IsAttached()) {
+            demuxer->m_preTuned = true;
+        }
+
+        last = last && !demuxer->m_preTuned;
+
+        if(last) {
+            m_demuxers.erase(demuxer->m_uid);
+        }
+        else {
+            demuxer->SetPriority(priority);
+        }
+    }
+
+    if(last) {
+        delete demuxer;
+    }
+}
+
+size_t LiveDemuxer::getDemuxerCount() {
+    std::lock_guard<std::mutex> lock(m_mutexDemuxers);
+    return m_demuxers.size();
+}
+
+void LiveDemuxer::setGopCacheSize(size_t size) {
+    m_gopCacheSize = size;
+    isyslog("GOP cache size: %lu bytes", size);
+}
+
+bool LiveDemuxer::preTune(const cChannel* channel) {
+    uint32_t uid = createChannelUid(channel);
+
+    std::unique_lock<std::mutex> lock(m_mutexDemuxers);
+    LiveDemuxer* demuxer = waitForTuning(lock, uid);
+
+    if(demuxer != nullptr) {
+        demuxer->m_preTuned = true;
+        return demuxer->IsAttached();
+    }
+
+    // reserve the channel, clients subscribing meanwhile wait for the tuner
+    demuxer = new LiveDemuxer(uid, MINPRIORITY);
+    demuxer->m_tuning = true;
+    m_demuxers[uid] = demuxer;
+    lock.unlock();
+
+    // only use devices nobody else needs (or that already receive the transponder)
+    bool idle = (findTunedDevice(channel, MINPRIORITY) != nullptr || cDevice::GetDevice(channel, MINPRIORITY, false, true) != nullptr);
+    bool result = idle && (demuxer->switchChannel(channel, MINPRIORITY) == ROBOTV_RET_OK);
+
+    lock.lock();
+    demuxer->m_tuning = false;
+    m_tuneCondition.notify_all();
+
+    if(!result) {
+        m_demuxers.erase(uid);
+        lock.unlock();
+
+        delete demuxer;
+        return false;
+    }
+
+    demuxer->m_preTuned = true;
+
+    isyslog("pre-tuned channel %i - %s", channel->Number(), channel->Name());
+    return true;
+}
+
+void LiveDemuxer::releasePreTune(uint32_t uid) {
+    LiveDemuxer* demuxer = nullptr;
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutexDemuxers);
+        demuxer = waitForTuning(lock, uid);
+
+        if(demuxer == nullptr || !demuxer->m_preTuned) {
+            return;
+        }
+
+        demuxer->m_preTuned = false;
+
+        if(!demuxer->m_subscribers.empty()) {
+            return;
+        }
+
+        m_demuxers.erase(uid);
+    }
+
+    isyslog("releasing pre-tuned channel %08x", uid);
+    delete demuxer;
+}
+
+void LiveDemuxer::setKeepReceiving(bool keep) {
+    std::lock_guard<std::mutex> lock(m_mutexDemuxers);
+    m_keepReceiving = keep;
+}
+
+std::vector<uint32_t> LiveDemuxer::getSubscribedChannels() {
+    std::lock_guard<std::mutex> lock(m_mutexDemuxers);
+    std::vector<uint32_t> result;
+
+    for(const auto& i : m_demuxers) {
+        if(!i.second->m_subscribers.empty()) {
+            result.push_back(i.first);
+        }
+    }
+
+    return result;
+}
+
+std::vector<uint32_t> LiveDemuxer::getPreTunedChannels() {
+    std::lock_guard<std::mutex> lock(m_mutexDemuxers);
+    std::vector<uint32_t> result;
+
+    for(const auto& i : m_demuxers) {
+        if(i.second->m_preTuned) {
+            result.push_back(i.first);
+        }
+    }
+
+    return result;
+}
+
+bool LiveDemuxer::isReceiving(uint32_t uid) {
+    std::lock_guard<std::mutex> lock(m_mutexDemuxers);
+    auto i = m_demuxers.find(uid);
+
+    return (i != m_demuxers.end() && i->second->IsAttached());
+}
+
+bool LiveDemuxer::hasStreams(const cChannel* channel, const std::set<int>& pids) {
+    if(pids.empty()) {
+        return true;
+    }
+
+    StreamBundle streams = createFromChannel(channel);
+
+    for(int pid : pids) {
+        if(streams.find(pid) != streams.end()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+size_t LiveDemuxer::getSubscriberCount() {
+    std::lock_guard<std::mutex> lock(m_demuxMutex);
+    return m_subscribers.size();
+}
+
+cDevice* LiveDemuxer::findTunedDevice(const cChannel* channel, int priority) {
+    // CAM assignment of encrypted channels is left to VDR
+    if(channel->Ca(0) >= CA_ENCRYPTED_MIN) {
+        return nullptr;
+    }
+
+    for(int i = 0; i < cDevice::NumDevices(); i++) {
+        cDevice* device = cDevice::GetDevice(i);
+
+        if(device == nullptr || !device->IsTunedToTransponder(channel)) {
+            continue;
+        }
+
+        bool needsDetachReceivers = false;
+
+        if(device->ProvidesChannel(channel, priority, &needsDetachReceivers) && !needsDetachReceivers) {
+            return device;
+        }
+    }
+
+    return nullptr;
+}
+
+int LiveDemuxer::switchChannel(const cChannel* channel, int priority) {
+    // prefer a device already tuned to the transponder
+    // (clients and recordings of the same bouquet share one tuner)
+    cDevice* device = findTunedDevice(channel, priority);
+
+    if(device != nullptr) {
+        m_sharedTuneCount++;
+        isyslog("Sharing device %d already tuned to the transponder", device->DeviceNumber() + 1);
+    }
+    // get device for this channel
+    else {
+        device = cDevice::GetDevice(channel, priority, false);
+    }
+
+    // maybe an encrypted channel that cannot be handled
+    // lets try if a device can decrypt it on it's own (without a CAM slot)
+    if(device == nullptr) {
+        device = cDevice::GetDeviceForTransponder(channel, priority);
+    }
+
+    // maybe all devices busy
+    if(device == nullptr) {
+        esyslog("No device available !");
+        return ROBOTV_RET_DATALOCKED;
+    }
+
+    m_tuneCount++;
+
+    isyslog("Found available device %d (%lu of %lu tunes shared a transponder)",
+        device->DeviceNumber() + 1, (uint64_t)m_sharedTuneCount, (uint64_t)m_tuneCount);
+
+    if(!device->SwitchChannel(channel, false)) {
+        esyslog("Can't switch to channel %i - %s", channel->Number(), channel->Name());
+        return ROBOTV_RET_ERROR;
+    }
+
+    StreamBundle currentItem = createFromChannel(channel);
+
+    // get cached demuxer data
+    ChannelCache &cache = ChannelCache::instance();
+    StreamBundle cacheItem = cache.lookup(m_uid);
+
+    // channel already in cache
+    if (!cacheItem.empty()) {
+        isyslog("Channel information found in cache");
+    }
+    // channel not found in cache -> add it from vdr
+    else {
+        isyslog("adding channel to cache");
+        cacheItem = currentItem;
+        cache.add(m_uid, cacheItem);
+    }
+
+    // recheck cache item
+    if (!currentItem.isMetaOf(cacheItem)) {
+        isyslog("current channel differs from cache item - updating");
+        cacheItem = currentItem;
+        cache.add(m_uid, cacheItem);
+    }
+
+    if(cacheItem.empty()) {
+        esyslog("channel %i - %s doesn't have any stream information", channel->Number(), channel->Name());
+        return ROBOTV_RET_ERROR;
+    }
+
+    isyslog("Creating demuxers");
+
+    {
+        std::lock_guard<std::mutex> lock(m_demuxMutex);
+        m_streams = cacheItem;
+        createDemuxers(&m_streams);
+        onStreamChange();
+
+        // receive all streams of the channel
+        // (unselected streams are dropped by the demuxers, clients can
+        // select them later without detaching the receiver)
+        SetPids(nullptr);
+
+        for(const auto& i : m_streams) {
+            AddPid(i.second.getPid());
+        }
+    }
+
+    isyslog("Successfully switched to channel %i - %s", channel->Number(), channel->Name());
+
+    if(!attachReceiver(device)) {
+        return ROBOTV_RET_ERROR;
+    }
+
+    m_channelText = (const char*)channel->ToText();
+
+    isyslog("done switching.");
+    return ROBOTV_RET_OK;
+}
+
+bool LiveDemuxer::attachReceiver(cDevice* device) {
+    // fool device to not start the decryption timer
+    int priority = Priority();
+    SetPriority(MINPRIORITY);
+
+    /// attach receiver
+    if (device->AttachReceiver(this) == false) {
+        esyslog("failed to attach receiver !");
+        SetPriority(priority);
+        return false;
+    }
+
+    // start decrypting manually
+    cCamSlot* slot = device->CamSlot();
+
+    if(slot) {
+        slot->StartDecrypting();
+    }
+
+    SetPriority(priority);
+    return true;
+}
+
+std::set<int> LiveDemuxer::getWantedPids() {
+    // pre-tuned channels cache all streams for any client
+    if(m_subscribers.empty() || m_preTuned) {
+        return std::set<int>();
+    }
+
+    std::set<int> pids = m_subscribers.front().pids;
+
+    for(const auto& s : m_subscribers) {
+        pids = mergePids(pids, s.pids);
+    }
+
+    return pids;
+}
+
+bool LiveDemuxer::needsPids(const std::set<int>& pids) const {
+    // all streams are demuxed already
+    if(m_pids.empty()) {
+        return false;
+    }
+
+    return pids.empty() || !std::includes(m_pids.begin(), m_pids.end(), pids.begin(), pids.end());
+}
+
+void LiveDemuxer::updatePids(const std::set<int>& pids) {
+    isyslog("updating demuxed streams of channel %08x", m_uid);
+
+    // the receiver already gets all streams, only the demuxers are rebuilt
+    std::lock_guard<std::mutex> lock(m_demuxMutex);
+
+    while(demux(1000) > 0);
+    flush();
+    clearGopCache();
+
+    m_pids = pids;
+    createDemuxers(&m_streams);
+    onStreamChange();
+}
+
+void LiveDemuxer::processChannelChange(const cChannel* channel) {
+    if(createChannelUid(channel) != m_uid) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutexDemuxers);
+
+    // wait for a pending change
+    m_tuneCondition.wait(lock, [&]() {
+        return !m_tuning;
+    });
+
+    // every client of the channel reports the same change
+    if(m_channelText == (const char*)channel->ToText()) {
+        return;
+    }
+
+    isyslog("ChannelChange()");
+
+    // pre-tuned channels must not take devices from anyone else
+    {
+        std::lock_guard<std::mutex> lockDemux(m_demuxMutex);
+        m_pids = getWantedPids();
+    }
+
+    int priority = m_subscribers.empty() ? MINPRIORITY : LIVEPRIORITY;
+
+    m_tuning = true;
+    lock.unlock();
+
+    Detach();
+
+    // process the remaining packets of the old setup
+    {
+        std::lock_guard<std::mutex> lockDemux(m_demuxMutex);
+
+        while(demux(1000) > 0);
+        flush();
+        clearGopCache();
+    }
+
+    switchChannel(channel, priority);
+
+    lock.lock();
+    m_tuning = false;
+    m_tuneCondition.notify_all();
+}
+
+void LiveDemuxer::createDemuxers(StreamBundle* bundle) {
+    DemuxerBundle& demuxers = getDemuxers();
+    StreamBundle selected;
+
+    // demux only the streams needed by the clients
+    for(const auto& i : *bundle) {
+        if(wantsPid(m_pids, i.second.getPid())) {
+            selected.addStream(i.second);
+        }
+    }
+
+    if(selected.empty()) {
+        selected = *bundle;
+    }
+
+    // update demuxers
+    demuxers.updateFrom(&selected);
+}
+
+MsgPacket* LiveDemuxer::createStreamChangePacket(DemuxerBundle& bundle) {
+    // update the channel cache with the parsed streams
+    // (only if all streams are demuxed)
+    if(m_pids.empty()) {
+        StreamBundle cache;
+
+        for(auto i = bundle.begin(); i != bundle.end(); i++) {
+            cache.addStream(*(*i));
+        }
+
+        ChannelCache::instance().add(m_uid, cache);
+    }
+
+    // the packets are created for every client in onPacket()
+    return nullptr;
+}
+
+MsgPacket* LiveDemuxer::createStreamChangePacket(const Subscriber& subscriber) {
+    DemuxerBundle& bundle = getDemuxers();
+
+    // reorder streams as preferred
+    bundle.reorderStreams(subscriber.language.c_str(), subscriber.streamType);
+
+    return StreamPacketProcessor::createStreamChangePacket(bundle, subscriber.pids);
+}
+
+void LiveDemuxer::Receive(const uchar* packet, int length) {
+    int64_t timeStamp = roboTV::currentTimeMillis().count();
+    bool wakeup = false;
+
+    // hand the packets over to the demuxer thread (never blocks)
+    for(int i = 0; i + (int)TsRing::packetSize <= length; i += TsRing::packetSize) {
+        wakeup |= m_ring.put(packet + i, timeStamp);
+    }
+
+    // the demuxer thread checks the ring with m_wakeupMutex locked
+    // (locking it once makes sure it either sees the packets or waits already)
+    if(wakeup) {
+        {
+            std::lock_guard<std::mutex> lock(m_wakeupMutex);
+        }
+
+        m_demuxCondition.notify_one();
+    }
+}
+
+void LiveDemuxer::demuxLoop() {
+    auto lastCheck = steady_clock::now();
+
+    while(m_demuxRunning) {
+        {
+            std::lock_guard<std::mutex> lock(m_demuxMutex);
+
+            // let channel changes in between large amounts of data
+            if(demux(1000) > 0) {
+                continue;
+            }
+        }
+
+        // the receiver wakes us up if the ring was empty
+        {
+            std::unique_lock<std::mutex> lock(m_wakeupMutex);
+
+            m_demuxCondition.wait(lock, [&]() {
+                return m_ring.size() > 0 || !m_demuxRunning;
+            });
+        }
+
+        // report overflows
+        if(steady_clock::now() - lastCheck >= seconds(5)) {
+            uint64_t overflowCount = m_ring.overflowCount();
+
+            if(overflowCount != m_lastOverflowCount) {
+                esyslog("TS ring overflow: %lu packets dropped (max %lu of %lu packets used)",
+                    overflowCount - m_lastOverflowCount, m_ring.maxSize(), m_ring.capacity());
+                m_lastOverflowCount = overflowCount;
+            }
+
+            lastCheck = steady_clock::now();
+        }
+    }
+}
+
+int LiveDemuxer::demux(int maxCount) {
+    int count = 0;
+    int64_t timeStamp = 0;
+    uint8_t* packet = nullptr;
+
+    while(count < maxCount && (packet = m_ring.front(timeStamp)) != nullptr) {
+        putTsPacket(packet, timeStamp);
+        m_ring.pop();
+        count++;
+    }
+
+    return count;
+}
+
+StreamBundle LiveDemuxer::createFromChannel(const cChannel* channel) {
+    StreamBundle item;
+
+    // add video stream
+    int vpid = channel->Vpid();
+    int vtype = channel->Vtype();
+
+    item.addStream(StreamInfo(vpid,
+                              vtype == 0x02 ? StreamInfo::Type::MPEG2VIDEO :
+                              vtype == 0x1b ? StreamInfo::Type::H264 :
+                              vtype == 0x24 ? StreamInfo::Type::H265 :
+                              StreamInfo::Type::NONE));
+
+    // add (E)AC3 streams
+    for(int i = 0; channel->Dpid(i) != 0; i++) {
+        int dtype = channel->Dtype(i);
+        item.addStream(StreamInfo(channel->Dpid(i),
+                                  dtype == 0x6A ? StreamInfo::Type::AC3 :
+                                  dtype == 0x7A ? StreamInfo::Type::EAC3 :
+                                  StreamInfo::Type::NONE,
+                                  channel->Dlang(i)));
+    }
+
+    // add audio streams
+    for(int i = 0; channel->Apid(i) != 0; i++) {
+        int atype = channel->Atype(i);
+        item.addStream(StreamInfo(channel->Apid(i),
+                                  atype == 0x04 ? StreamInfo::Type::MPEG2AUDIO :
+                                  atype == 0x03 ? StreamInfo::Type::MPEG2AUDIO :
+                                  atype == 0x0f ? StreamInfo::Type::AAC :
+                                  atype == 0x11 ? StreamInfo::Type::LATM :
+                                  StreamInfo::Type::NONE,
+                                  channel->Alang(i)));
+    }
+
+    // add subtitle streams
+    for(int i = 0; channel->Spid(i) != 0; i++) {
+        StreamInfo stream(channel->Spid(i), StreamInfo::Type::DVBSUB, channel->Slang(i));
+
+        stream.setSubtitlingDescriptor(
+                channel->SubtitlingType(i),
+                channel->CompositionPageId(i),
+                channel->AncillaryPageId(i));
+
+        item.addStream(stream);
+    }
+
+    return item;
+}
+
+int64_t LiveDemuxer::getCurrentTime(TsDemuxer::StreamPacket *p) {
+    return p->streamPosition;
+}
+
+void LiveDemuxer::onPacket(MsgPacket* p, StreamInfo::Content content, int64_t pts) {
+    // stream information is ordered by the language of every client
+    // (only the writing client of a timeshift queue needs it)
+    if(content == StreamInfo::Content::STREAMINFO) {
+        delete p;
+        clearGopCache();
+
+        for(auto& s : m_subscribers) {
+            s.streamInfo = true;
+
+            if(s.queue->isWriter(s.reader)) {
+                s.queue->queue(s.reader, createStreamChangePacket(s), content, pts);
+            }
+        }
+
+        return;
+    }
+
+    // clients joining the running stream
+    for(auto& s : m_subscribers) {
+        if(!s.streamInfo) {
+            startSubscriber(s);
+        }
+    }
+
+    std::shared_ptr<MsgPacket> packet(p);
+    cachePacket(packet, content, pts);
+
+    // fan out the packet to all timeshift queues
+    // (clients sharing a queue get it through the writing client)
+    int pid = packetPid(p);
+
+    for(auto& s : m_subscribers) {
+        if(wantsPid(s.pids, pid) && s.queue->isWriter(s.reader)) {
+            s.queue->queue(s.reader, packet, content, pts);
+        }
+    }
+}
+
+void LiveDemuxer::startSubscriber(Subscriber& subscriber) {
+    subscriber.streamInfo = true;
+
+    // clients sharing a queue already have the stream
+    if(!subscriber.queue->isWriter(subscriber.reader)) {
+        return;
+    }
+
+    subscriber.queue->queue(subscriber.reader, createStreamChangePacket(subscriber), StreamInfo::Content::STREAMINFO, 0);
+
+    if(!m_gopCacheValid) {
+        return;
+    }
+
+    dsyslog("starting client %i with %lu cached packets (%lu bytes)",
+        subscriber.reader->socket, m_gopCache.size(), m_gopCacheLength);
+
+    for(const auto& c : m_gopCache) {
+        if(wantsPid(subscriber.pids, packetPid(c.p.get()))) {
+            subscriber.queue->queue(subscriber.reader, c.p, c.content, c.pts);
+        }
+    }
+}
+
+void LiveDemuxer::cachePacket(const std::shared_ptr<MsgPacket>& p, StreamInfo::Content content, int64_t pts) {
+    if(m_gopCacheSize == 0) {
+        return;
+    }
+
+    // keyframe starts a new GOP
+    if(content == StreamInfo::Content::VIDEO && p->getClientID() == (uint16_t)StreamInfo::FrameType::IFRAME) {
+        clearGopCache();
+        m_gopCacheValid = true;
+    }
+
+    if(!m_gopCacheValid) {
+        return;
+    }
+
+    // GOP too large -> wait for the next keyframe
+    if(m_gopCacheLength + p->getPayloadLength() > m_gopCacheSize || m_gopCache.size() >= maxGopPackets) {
+        dsyslog("GOP of channel %08x exceeds cache size", m_uid);
+        clearGopCache();
+        return;
+    }
+
+    m_gopCache.push_back({p, content, pts});
+    m_gopCacheLength += p->getPayloadLength();
+}
+
+void LiveDemuxer::clearGopCache() {
+    m_gopCache.clear();
+    m_gopCacheLength = 0;
+    m_gopCacheValid = false;
+}
@@ -0,0 +1,385 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_LIVEDEMUXER_H
+#define ROBOTV_LIVEDEMUXER_H
+
+#include <stdint.h>
+#include <vdr/channels.h>
+#include <vdr/device.h>
+#include <vdr/receiver.h>
+
+#include "robotvdmx/demuxer.h"
+#include "robotvdmx/streambundle.h"
+#include "robotvdmx/demuxerbundle.h"
+#include "livequeue.h"
+#include "tsring.h"
+
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <condition_variable>
+#include <robotv/StreamPacketProcessor.h>
+
+/**
+ * Shared receiver and demuxer of a channel.
+ * All clients watching the same channel subscribe to one LiveDemuxer, which
+ * attaches a single receiver and demuxes the transport stream once. Stream
+ * packets are fanned out to the timeshift queues of the clients, the stream
+ * information is ordered by the preferred language of each client.
+ * The packets since the last video keyframe are kept, so clients joining
+ * the channel can start decoding immediately.
+ */
+class LiveDemuxer : public cReceiver, protected StreamPacketProcessor {
+public:
+
+    /**
+     * Subscribe a client to the demuxer of a channel.
+     * The demuxer is created and attached to a device on first use.
+     * @param channel channel to receive
+     * @param priority receiver priority of the client
+     * @param queue timeshift queue of the client
+     * @param reader read cursor of the client (identifies the subscription)
+     * @param language preferred audio language of the client
+     * @param streamType preferred audio stream type of the client
+     * @param pids pids of the streams the client wants (empty for all streams)
+     * @param status receives the result (ROBOTV_RET_*)
+     * @return the demuxer or nullptr if the channel can't be received
+     */
+    static LiveDemuxer* subscribe(
+        const cChannel* channel,
+        int priority,
+        LiveQueue* queue,
+        LiveQueue::Reader* reader,
+        const std::string& language,
+        StreamInfo::Type streamType,
+        const std::set<int>& pids,
+        int& status);
+
+    /**
+     * Unsubscribe a client.
+     * The demuxer is destroyed when the last client unsubscribed.
+     * @param demuxer demuxer of the channel
+     * @param reader read cursor of the client
+     */
+    static void unsubscribe(LiveDemuxer* demuxer, LiveQueue::Reader* reader);
+
+    /**
+     * Get the number of demuxed channels.
+     */
+    static size_t getDemuxerCount();
+
+    /**
+     * Receive a channel without clients (pre-tuning).
+     * Only idle devices are used. The receiver runs with the lowest priority,
+     * so VDR detaches it as soon as the device is needed for anything else.
+     * @param channel channel to receive
+     * @return true if the channel is received
+     */
+    static bool preTune(const cChannel* channel);
+
+    /**
+     * Stop pre-tuning a channel.
+     * The demuxer is destroyed if no client is subscribed.
+     * @param uid channel uid
+     */
+    static void releasePreTune(uint32_t uid);
+
+    /**
+     * Keep channels pre-tuned after the last client unsubscribed.
+     * @param keep true to keep receiving until releasePreTune() is called
+     */
+    static void setKeepReceiving(bool keep);
+
+    /**
+     * Get the uids of all channels with subscribed clients.
+     */
+    static std::vector<uint32_t> getSubscribedChannels();
+
+    /**
+     * Get the uids of all pre-tuned channels.
+     */
+    static std::vector<uint32_t> getPreTunedChannels();
+
+    /**
+     * Check if the receiver of a channel is attached to a device.
+     * @param uid channel uid
+     * @return false if the channel isn't received (or has been detached by VDR)
+     */
+    static bool isReceiving(uint32_t uid);
+
+    /**
+     * Check if a stream selection matches the streams of a channel.
+     * @param channel channel to check
+     * @param pids selected pids (empty for all streams)
+     * @return false if none of the selected streams belongs to the channel
+     */
+    static bool hasStreams(const cChannel* channel, const std::set<int>& pids);
+
+    /**
+     * Get the number of devices selected for channels.
+     */
+    static uint64_t getTuneCount() {
+        return m_tuneCount;
+    }
+
+    /**
+     * Get the number of channels received on a device already tuned to
+     * their transponder (fresh tunes avoided).
+     */
+    static uint64_t getSharedTuneCount() {
+        return m_sharedTuneCount;
+    }
+
+    /**
+     * Set the maximum size of the keyframe cache per channel.
+     * GOPs exceeding this size are not cached.
+     * @param size size in bytes (0 disables the cache)
+     */
+    static void setGopCacheSize(size_t size);
+
+    void processChannelChange(const cChannel* channel);
+
+    size_t getSubscriberCount();
+
+    cDevice* getDevice() {
+        return Device();
+    }
+
+    /**
+     * Get the number of TS packets waiting for the demuxer.
+     */
+    size_t getRingFill() const {
+        return m_ring.size();
+    }
+
+    /**
+     * Get the number of TS packets dropped because the demuxer didn't keep up.
+     */
+    uint64_t getRingOverflows() const {
+        return m_ring.overflowCount();
+    }
+
+protected:
+
+#if VDRVERSNUM < 20300
+    void Receive(uchar* data, int length);
+#else
+    void Receive(const uchar* Data, int Length);
+#endif
+
+    int64_t getCurrentTime(TsDemuxer::StreamPacket *p);
+
+    void onPacket(MsgPacket* p, StreamInfo::Content content, int64_t pts);
+
+    MsgPacket* createStreamChangePacket(DemuxerBundle& bundle);
+
+private:
+
+    struct Subscriber {
+        LiveQueue* queue;
+        LiveQueue::Reader* reader;
+        int priority;
+        std::string language;
+        StreamInfo::Type streamType;
+        std::set<int> pids;
+        bool streamInfo;
+    };
+
+    struct CachedPacket {
+        std::shared_ptr<MsgPacket> p;
+        StreamInfo::Content content;
+        int64_t pts;
+    };
+
+    LiveDemuxer(uint32_t uid, int priority);
+
+    virtual ~LiveDemuxer();
+
+    /**
+     * Find a demuxer in the map and wait until it isn't tuned anymore.
+     * @param lock lock of m_mutexDemuxers (released while waiting)
+     * @param uid channel uid
+     * @return the demuxer or nullptr if the channel isn't received
+     */
+    static LiveDemuxer* waitForTuning(std::unique_lock<std::mutex>& lock, uint32_t uid);
+
+    /**
+     * Switch the channel with m_mutexDemuxers released.
+     * Other threads wait for the tuner in the meantime.
+     * @param lock lock of m_mutexDemuxers
+     * @param channel channel to receive
+     * @param priority priority used to select the device
+     * @return ROBOTV_RET_OK on success
+     */
+    int tune(std::unique_lock<std::mutex>& lock, const cChannel* channel, int priority);
+
+    /**
+     * Tune a device and attach the receiver.
+     * @param channel channel to receive
+     * @param priority priority used to select the device
+     * @return ROBOTV_RET_OK on success
+     */
+    int switchChannel(const cChannel* channel, int priority);
+
+    /**
+     * Find a device already tuned to the transponder of a channel.
+     * The device must provide the channel without detaching any receivers.
+     * @param channel channel to receive
+     * @param priority priority of the receiver
+     * @return the device or nullptr if the transponder isn't received
+     */
+    static cDevice* findTunedDevice(const cChannel* channel, int priority);
+
+    bool attachReceiver(cDevice* device);
+
+    /**
+     * Get the pids needed by all clients (m_mutexDemuxers must be locked).
+     * @return pids or an empty set if all streams are needed
+     */
+    std::set<int> getWantedPids();
+
+    /**
+     * Check if the demuxers lack streams needed by the clients.
+     * @param pids wanted pids (see getWantedPids())
+     */
+    bool needsPids(const std::set<int>& pids) const;
+
+    /**
+     * Demux the streams added by a client (the demuxer must be tuning).
+     * The receiver keeps running, only the demuxers are recreated.
+     * Streams nobody needs anymore are demuxed until the next channel change,
+     * so other clients are not interrupted.
+     * @param pids wanted pids (see getWantedPids())
+     */
+    void updatePids(const std::set<int>& pids);
+
+    static StreamBundle createFromChannel(const cChannel* channel);
+
+    void createDemuxers(StreamBundle* bundle);
+
+    /**
+     * Create the stream information for a subscriber (m_demuxMutex must be locked).
+     */
+    MsgPacket* createStreamChangePacket(const Subscriber& subscriber);
+
+    /**
+     * Put a stream packet into the GOP cache (m_demuxMutex must be locked).
+     * A video keyframe starts a new GOP. The packet is shared with the
+     * timeshift queues, not copied.
+     */
+    void cachePacket(const std::shared_ptr<MsgPacket>& p, StreamInfo::Content content, int64_t pts);
+
+    void clearGopCache();
+
+    /**
+     * Start a client with the stream information and the cached GOP
+     * (m_demuxMutex must be locked).
+     */
+    void startSubscriber(Subscriber& subscriber);
+
+    void demuxLoop();
+
+    /**
+     * Demux all packets of the ring (m_demuxMutex must be locked).
+     * @param maxCount maximum number of packets to process
+     * @return number of packets processed
+     */
+    int demux(int maxCount);
+
+    uint32_t m_uid;
+
+    // channel definition the receiver has been set up for
+    std::string m_channelText;
+
+    // all streams of the channel
+    StreamBundle m_streams;
+
+    // demuxed streams (empty for all streams, changed with m_demuxMutex locked)
+    std::set<int> m_pids;
+
+    // protected by m_demuxMutex (modified with m_mutexDemuxers locked)
+    std::list<Subscriber> m_subscribers;
+
+    // protected by m_mutexDemuxers
+    bool m_preTuned = false;
+
+    // a thread switches the channel or the streams with m_mutexDemuxers
+    // released (protected by m_mutexDemuxers)
+    bool m_tuning = false;
+
+    // raw TS packets from the receiver thread
+    TsRing m_ring;
+
+    std::thread* m_demuxThread = nullptr;
+
+    std::atomic<bool> m_demuxRunning;
+
+    // serializes demuxing with channel changes and subscriptions
+    std::mutex m_demuxMutex;
+
+    // guards waiting for packets (never held while demuxing)
+    std::mutex m_wakeupMutex;
+
+    std::condition_variable m_demuxCondition;
+
+    uint64_t m_lastOverflowCount = 0;
+
+    // packets since the last video keyframe (protected by m_demuxMutex)
+    std::deque<CachedPacket> m_gopCache;
+
+    size_t m_gopCacheLength = 0;
+
+    // a keyframe has been cached
+    bool m_gopCacheValid = false;
+
+    static size_t m_gopCacheSize;
+
+    // a replayed GOP must fit into the writer queue of a timeshift queue
+    // (with room for the live packets arriving meanwhile)
+    static const size_t maxGopPackets = LiveQueue::maxQueueSize / 2;
+
+    static std::map<uint32_t, LiveDemuxer*> m_demuxers;
+
+    static std::mutex m_mutexDemuxers;
+
+    // signaled when a demuxer finished tuning
+    static std::condition_variable m_tuneCondition;
+
+    static bool m_keepReceiving;
+
+    static std::atomic<uint64_t> m_tuneCount;
+
+    static std::atomic<uint64_t> m_sharedTuneCount;
+};
+
+#endif // ROBOTV_LIVEDEMUXER_H
@@ -27,43 +27,184 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/statvfs.h>
+#include <limits.h>
+
+#include <algorithm>
 
 #include "config/config.h"
 #include "net/msgpacket.h"
 #include "livequeue.h"
+#include "timeshiftrecord.h"
 #include "tools/time.h"
 
-cString LiveQueue::m_timeShiftDir = "/video";
+std::vector<std::string> LiveQueue::m_timeShiftDirs = { "/video" };
 uint64_t LiveQueue::m_bufferSize = 1024 * 1024 * 1024;
+uint64_t LiveQueue::m_totalBufferSize = 0;
+int LiveQueue::m_maxBufferTime = 0;
+LiveQueue::StorageMode LiveQueue::m_storageMode = LiveQueue::StorageMode::FILE;
+uint64_t LiveQueue::m_liveCacheSize = 4 * 1024 * 1024;
+std::map<std::string, LiveQueue*> LiveQueue::m_queues;
+std::mutex LiveQueue::m_mutexQueues;
+int LiveQueue::m_nextStorageId = 0;
+std::list<LiveQueue::PoolFile> LiveQueue::m_filePool;
+int LiveQueue::m_filePoolSize = 2;
+std::mutex LiveQueue::m_mutexPool;
+std::thread* LiveQueue::m_poolThread = nullptr;
+std::atomic<bool> LiveQueue::m_poolRunning(false);
+
+static MsgPacket* copyPacket(MsgPacket* p) {
+    MsgPacket* copy = new MsgPacket(p->getMsgID(), p->getType());
+
+    copy->put_Blob(p->getPayload(), p->getPayloadLength());
+    copy->setClientID(p->getClientID());
+
+    return copy;
+}
 
-LiveQueue::LiveQueue(int socket) : m_readFd(-1), m_writeFd(-1), m_socket(socket) {
-    m_wrapped = false;
+LiveQueue::LiveQueue(const std::string& id) : m_readFd(-1), m_writeFd(-1), m_id(id) {
+    m_writePosition = 0;
+    m_wrapPosition = 0;
+    m_storageLength = 0;
+    m_liveCacheLength = 0;
     m_hasWrapped = false;
+    m_storageId = m_nextStorageId++;
+    m_storageDir = selectTimeShiftDir();
     m_writerRunning = true;
     m_wrapCount = 0;
     m_queueStartTime = roboTV::currentTimeMillis();
-    m_lastSyncTime = roboTV::currentTimeMillis();
+    m_syncPosition = 0;
+    m_bufferLimit = m_bufferSize;
+    m_bitRate = 0;
+    m_bitRateBytes = 0;
+    m_bitRateStart = std::chrono::steady_clock::now();
     m_writeThread = nullptr;
 }
 
 LiveQueue::~LiveQueue() {
-    m_writerRunning = false;
-    close();
+    // stop writer thread
+    {
+        std::lock_guard<std::mutex> lock(m_mutexQueue);
+        m_writerRunning = false;
+    }
+
+    m_writerCondition.notify_one();
 
     if(m_writeThread != nullptr) {
         m_writeThread->join();
     }
 
-    while(!m_writerQueue.empty()) {
-        const PacketData& p = m_writerQueue.front();
-        delete p.p;
-        m_writerQueue.pop_front();
-    }
+    close();
+    clearLiveCache();
+    m_writerQueue.clear();
 
     delete m_writeThread;
+
+    logStatistics();
     isyslog("LiveQueue terminated");
 }
 
+LiveQueue* LiveQueue::attach(const std::string& id, int socket, Reader*& reader) {
+    LiveQueue* queue = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutexQueues);
+        auto i = m_queues.find(id);
+
+        if(i != m_queues.end()) {
+            queue = i->second;
+        }
+        else {
+            queue = new LiveQueue(id);
+            m_queues[id] = queue;
+            rebalance();
+        }
+
+        reader = new Reader;
+        reader->socket = socket;
+
+        std::lock_guard<std::mutex> lockQueue(queue->m_mutex);
+        queue->m_readers.push_back(reader);
+
+        // join a running stream at the last keyframe
+        if(queue->m_streamInfo != nullptr) {
+            reader->packets.push_back(copyPacket(queue->m_streamInfo.get()));
+
+            if(!queue->m_indexList.empty()) {
+                queue->setReadPosition(reader, queue->m_indexList.back());
+            }
+            else {
+                queue->resetReadPosition(reader, queue->m_writePosition);
+            }
+        }
+
+        // first client writes into the queue
+        {
+            std::lock_guard<std::mutex> lockWriter(queue->m_mutexQueue);
+
+            if(queue->m_writer == nullptr) {
+                queue->m_writer = reader;
+            }
+        }
+
+        isyslog("client %i attached to timeshift queue %s (%lu clients)", socket, id.c_str(), queue->m_readers.size());
+    }
+
+    return queue;
+}
+
+void LiveQueue::detach(LiveQueue* queue, Reader* reader) {
+    if(queue == nullptr || reader == nullptr) {
+        return;
+    }
+
+    bool last = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutexQueues);
+        std::lock_guard<std::mutex> lockQueue(queue->m_mutex);
+
+        queue->m_readers.remove(reader);
+        last = queue->m_readers.empty();
+
+        // hand over writing to the next client
+        {
+            std::lock_guard<std::mutex> lockWriter(queue->m_mutexQueue);
+
+            if(queue->m_writer == reader) {
+                queue->m_writer = last ? nullptr : queue->m_readers.front();
+                queue->m_resync = true;
+            }
+        }
+
+        if(last) {
+            m_queues.erase(queue->m_id);
+            rebalance();
+        }
+    }
+
+    isyslog("client %i detached from timeshift queue %s", reader->socket, queue->m_id.c_str());
+    isyslog("timeshift reader: %lu packets from memory, %lu from storage", reader->liveReadCount, reader->storageReadCount);
+
+    if(reader->overrunCount > 0) {
+        isyslog("timeshift reader of client %i overrun %lu times", reader->socket, reader->overrunCount);
+    }
+
+    for(auto p : reader->packets) {
+        delete p;
+    }
+
+    delete reader;
+
+    if(last) {
+        delete queue;
+    }
+}
+
 void LiveQueue::start() {
     if(m_writeThread != nullptr) {
         return;
@@ -74,327 +215,1594 @@ void LiveQueue::start() {
 
     m_writeThread = new std::thread([&]() {
         createRingBuffer();
+        writerLoop();
+    });
+
+}
 
-        while(m_writerRunning) {
+void LiveQueue::writerLoop() {
+    std::deque<PacketData> batch;
 
-            while(m_writerRunning && !m_writerQueue.empty()) {
-                PacketData p;
+    while(m_writerRunning) {
 
-                {
-                    std::lock_guard<std::mutex> lock(m_mutexQueue);
-                    p = m_writerQueue.front();
-                    m_writerQueue.pop_front();
-                }
+        // wait for packets (or termination)
+        {
+            std::unique_lock<std::mutex> lock(m_mutexQueue);
 
-                write(p);
+            m_writerCondition.wait(lock, [&]() {
+                return !m_writerRunning || !m_writerQueue.empty();
+            });
+
+            if(!m_writerRunning) {
+                break;
             }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            // take over all pending packets at once
+            batch.swap(m_writerQueue);
         }
-    });
 
+        write(batch);
+        writeback();
+        updateStatistics(batch);
+        batch.clear();
+
+        // split the timeshift budget by the new bitrate
+        if(updateBitRate()) {
+            std::lock_guard<std::mutex> lock(m_mutexQueues);
+            rebalance();
+        }
+    }
 }
 
-void LiveQueue::createRingBuffer() {
-    std::lock_guard<std::mutex> lock(m_mutex);
+bool LiveQueue::updateBitRate() {
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_bitRateStart);
+
+    if(elapsed < std::chrono::seconds(10)) {
+        return false;
+    }
 
-    m_pause = false;
-    off_t length = (off_t)m_bufferSize + 1024 * 1024;
+    uint64_t bitRate = m_bitRateBytes * 1000 / elapsed.count();
+    uint64_t last = m_bitRate;
 
-    m_storage = cString::sprintf("%s/robotv-ringbuffer-%05i.data", (const char*)m_timeShiftDir, m_socket);
-    dsyslog("timeshift file: %s", (const char*)m_storage);
+    // smooth over the last measurements
+    m_bitRate = (last == 0) ? bitRate : (last * 3 + bitRate) / 4;
+    m_bitRateBytes = 0;
+    m_bitRateStart = now;
 
-    m_writeFd = open(m_storage, O_CREAT | O_WRONLY, 0644);
-    int rc = posix_fallocate(m_writeFd, 0, length);
+    return (m_totalBufferSize > 0 || m_maxBufferTime > 0);
+}
 
-    if(rc != 0) {
-        dsyslog("unable to pre-allocate %li bytes for timeshift ringbuffer", length);
-        dsyslog("ERROR: %s (status = %i)", strerror(rc), rc);
+void LiveQueue::rebalance() {
+    if(m_totalBufferSize == 0 && m_maxBufferTime == 0) {
+        return;
     }
 
-    m_readFd = open(m_storage, O_NOATIME | O_RDONLY, 0644);
-    posix_fadvise(m_readFd, 0, length, POSIX_FADV_SEQUENTIAL);
+    uint64_t totalBitRate = 0;
 
-    if(m_readFd == -1) {
-        esyslog("Failed to create timeshift ringbuffer !");
+    for(const auto& i : m_queues) {
+        uint64_t bitRate = i.second->m_bitRate;
+        totalBitRate += (bitRate == 0) ? defaultBitRate : bitRate;
     }
 
-    lseek(m_readFd, 0, SEEK_SET);
-    lseek(m_writeFd, 0, SEEK_SET);
+    for(const auto& i : m_queues) {
+        LiveQueue* queue = i.second;
+        uint64_t bitRate = queue->m_bitRate;
+        uint64_t size = m_bufferSize;
 
-}
+        // share of the total budget
+        if(m_totalBufferSize > 0) {
+            size = std::min(size, m_totalBufferSize * ((bitRate == 0) ? defaultBitRate : bitRate) / totalBitRate);
+        }
 
-MsgPacket* LiveQueue::read(bool keyFrameMode) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+        // limit to the maximum time
+        if(m_maxBufferTime > 0 && bitRate > 0) {
+            size = std::min(size, bitRate * 60 * m_maxBufferTime);
+        }
+
+        size = std::max<uint64_t>(size, std::min<uint64_t>((uint64_t)segmentSize, m_bufferSize));
+
+        if(size != queue->m_bufferLimit) {
+            dsyslog("timeshift queue %s: %lu bytes (%lu kbit/s)", i.first.c_str(), size, bitRate * 8 / 1000);
+            queue->m_bufferLimit = size;
+        }
+    }
+}
 
-    if(m_pause) {
-        return NULL;
+void LiveQueue::addWriteback(off_t position, off_t length) {
+    if(m_map != nullptr || length <= 0) {
+        return;
     }
 
-    if(keyFrameMode) {
-        seekNextKeyFrame();
+    // window already consumed by all clients ?
+    bool consumed = true;
+
+    for(auto reader : m_readers) {
+        if(reader->wrapped || reader->readPosition < position + length) {
+            consumed = false;
+        }
     }
 
-    return internalRead();
+    m_writebackRanges.push_back({position, length, consumed});
 }
 
-MsgPacket* LiveQueue::internalRead() {
-    // check if read position wrapped
+void LiveQueue::writeback() {
+    for(const auto& range : m_writebackRanges) {
 
-    off_t readPosition = lseek(m_readFd, 0, SEEK_CUR);
-    off_t writePosition = lseek(m_writeFd, 0, SEEK_CUR);
+        // start writeback of the completed window
+        sync_file_range(m_writeFd, range.position, range.length, SYNC_FILE_RANGE_WRITE);
 
-    if(readPosition == (off_t)-1 || writePosition == (off_t)-1) {
-        return nullptr;
-    }
+        // wait for the previous window to limit the amount of dirty pages
+        const WritebackRange& last = m_lastWriteback;
 
-    if(readPosition >= (off_t)m_bufferSize) {
-        isyslog("timeshift: read buffer wrap");
-        lseek(m_readFd, 0, SEEK_SET);
-        readPosition = 0;
-        m_wrapped = !m_wrapped;
-        isyslog("wrapped: %s", m_wrapped ? "yes" : "no");
-    }
+        if(last.length > 0) {
+            sync_file_range(m_writeFd, last.position, last.length,
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
 
-    // check if read position is still behind write position (if not wrapped))
-    // if not -> skip packet (as we would start reading from the beginning of
-    // the buffer)
+            // drop clean pages nobody will read again
+            if(last.consumed) {
+                posix_fadvise(m_writeFd, last.position, last.length, POSIX_FADV_DONTNEED);
+            }
+        }
 
-    if(readPosition >= writePosition && !m_wrapped) {
-        return nullptr;
+        m_lastWriteback = range;
     }
 
-    // read packet from storage
-    return MsgPacket::read(m_readFd, 1000);
+    m_writebackRanges.clear();
 }
 
-bool LiveQueue::isPaused() {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    return m_pause;
-}
+void LiveQueue::updateStatistics(const std::deque<PacketData>& batch) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m_mutexStatistics);
 
-void LiveQueue::queue(MsgPacket* p, StreamInfo::Content content, int64_t pts) {
-    start();
+    m_statistics.wakeupCount++;
 
-    {
-        std::lock_guard<std::mutex> lock(m_mutexQueue);
+    for(const auto& p : batch) {
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(now - p.queueTime);
 
-        if (m_writerQueue.size() >= 400) {
-            delete p;
-            return;
+        m_statistics.packetCount++;
+        m_statistics.latencySum += latency;
+
+        if(latency > m_statistics.latencyMax) {
+            m_statistics.latencyMax = latency;
         }
+    }
+}
+
+LiveQueue::Statistics LiveQueue::getStatistics() {
+    std::lock_guard<std::mutex> lock(m_mutexStatistics);
+    return m_statistics;
+}
+
+void LiveQueue::logStatistics() {
+    Statistics s = getStatistics();
+
+    if(s.packetCount == 0) {
+        return;
+    }
 
-        m_writerQueue.push_back({p, content, pts});
+    isyslog("timeshift writer: %lu packets in %lu wakeups (%lu write syscalls)", s.packetCount, s.wakeupCount, s.writeCount);
+    isyslog("timeshift write-to-readable latency: avg %li us / max %li us",
+            (long)(s.latencySum.count() / s.packetCount),
+            (long)s.latencyMax.count());
+
+    if(s.lockCount > 0) {
+        isyslog("timeshift writer lock hold time: avg %li us / max %li us (%lu locks)",
+                (long)(s.lockHoldSum.count() / s.lockCount),
+                (long)s.lockHoldMax.count(),
+                s.lockCount);
+    }
+
+    if(s.overflowCount > 0) {
+        isyslog("timeshift writer queue overflow %lu times", s.overflowCount);
+        isyslog("dropped packets: %lu non-reference frames, %lu reference frames, %lu other",
+                s.droppedNonReference, s.droppedReference, s.droppedOther);
+
+        if(s.droppedAudio > 0) {
+            esyslog("dropped %lu audio packets (writer queue full)", s.droppedAudio);
+        }
     }
 }
 
-bool LiveQueue::write(const PacketData& data) {
+void LiveQueue::createRingBuffer() {
     std::lock_guard<std::mutex> lock(m_mutex);
 
-    auto timeStamp = roboTV::currentTimeMillis();
-    auto p = data.p;
-    auto content = data.content;
-    auto pts = data.pts;
+    m_storageLength = (off_t)m_bufferSize + 1024 * 1024;
 
+    // pooled files already have their first segment allocated
+    std::string path;
+    bool pooled = takePoolFile(m_storageDir, path);
 
-    // first packet set start time
-    if(m_indexList.empty()) {
-        m_queueStartTime = roboTV::currentTimeMillis();
+    if(pooled) {
+        m_storage = path.c_str();
+    }
+    else {
+        m_storage = cString::sprintf("%s/robotv-ringbuffer-%05i.data", m_storageDir.c_str(), m_storageId);
     }
 
-    // ring-buffer overrun ?
+    dsyslog("timeshift file: %s%s", (const char*)m_storage, pooled ? " (pool)" : "");
 
-    off_t writePosition = lseek(m_writeFd, 0, SEEK_CUR);
-    off_t readPosition = lseek(m_readFd, 0, SEEK_CUR);
+    bool memoryMapped = (m_storageMode == StorageMode::MMAP);
 
-    if(writePosition >= (off_t) m_bufferSize) {
-        isyslog("timeshift: write buffer wrap");
-        lseek(m_writeFd, 0, SEEK_SET);
-        writePosition = 0;
+    m_writeFd = open(m_storage, O_CREAT | (memoryMapped ? O_RDWR : O_WRONLY), 0644);
 
-        m_wrapped = !m_wrapped;
-        m_hasWrapped = true;
-        m_wrapCount++;
+    // sparse file, storage is allocated segment by segment while writing
+    m_allocatedLength = pooled ? std::min<off_t>((off_t)segmentSize, m_storageLength) : 0;
 
-        isyslog("wrapped: %s", m_wrapped ? "yes" : "no");
+    if(ftruncate(m_writeFd, m_storageLength) != 0) {
+        esyslog("unable to resize timeshift ringbuffer: %s", strerror(errno));
     }
 
-    off_t packetEndPosition = writePosition + p->getPacketLength();
+    if(!allocateStorage(std::min<off_t>((off_t)segmentSize, m_storageLength))) {
+        dsyslog("unable to pre-allocate timeshift ringbuffer");
 
-    // check if write position if still behind read position (if wrapped)
-    // if not -> shift read position forward
+        // writing into a mapping without backing storage would raise SIGBUS
+        if(memoryMapped) {
+            esyslog("falling back to file based timeshift ringbuffer");
+            memoryMapped = false;
+        }
+    }
 
-    while(packetEndPosition >= readPosition && m_wrapped) {
-        if(internalRead() == nullptr) {
-            esyslog("write overlap - wrapped read position behind write position !");
-            delete p;
-            return false;
+    if(memoryMapped) {
+        void* map = mmap(nullptr, m_storageLength, PROT_READ | PROT_WRITE, MAP_SHARED, m_writeFd, 0);
+
+        if(map == MAP_FAILED) {
+            esyslog("unable to map timeshift ringbuffer: %s", strerror(errno));
+        }
+        else {
+            m_map = (uint8_t*)map;
+            madvise(m_map, m_storageLength, MADV_SEQUENTIAL);
+            dsyslog("timeshift ringbuffer memory mapped");
         }
     }
 
-    trim(packetEndPosition);
+    m_readFd = open(m_storage, O_NOATIME | O_RDONLY, 0644);
+    posix_fadvise(m_readFd, 0, m_storageLength, POSIX_FADV_SEQUENTIAL);
 
-    // add keyframe to map
-    bool keyFrame = (p->getClientID() == (uint16_t)StreamInfo::FrameType::IFRAME);
+    if(m_readFd == -1) {
+        esyslog("Failed to create timeshift ringbuffer !");
+    }
 
-    if(keyFrame && content == StreamInfo::Content::VIDEO) {
-        m_indexList.push_back({writePosition, timeStamp, pts, m_wrapCount});
+    for(auto reader : m_readers) {
+        resetReadPosition(reader, 0);
     }
 
-    // write packet
-    bool success = p->write(m_writeFd, 1000);
+    m_writePosition = 0;
+    m_wrapPosition = 0;
+}
+
+bool LiveQueue::read(Reader* reader, const PacketConsumer& consumer, bool keyFrameMode) {
+    std::unique_lock<std::mutex> lock(m_mutex);
 
-    if(!success) {
-        esyslog("Unable to write packet into timeshift ringbuffer !");
+    if(reader->pause) {
+        return false;
     }
 
-    // sync every 2 seconds
-    // we just want to avoid delays of the write-back cache hitting
-    // us on buffer-wrap (or any other occasion)
+    PacketView view;
+
+    // packets for this client only
+    if(!reader->packets.empty()) {
+        MsgPacket* p = reader->packets.front();
+        reader->packets.pop_front();
 
-    std::chrono::milliseconds now = roboTV::currentTimeMillis();
+        view.msgId = p->getMsgID();
+        view.clientId = p->getClientID();
+        view.payload = p->getPayload();
+        view.length = p->getPayloadLength();
+
+        consumer(view);
+        delete p;
+        return true;
+    }
 
-    if(now - m_lastSyncTime >= std::chrono::milliseconds(2000)) {
-        if(fdatasync(m_writeFd) != 0) {
-            esyslog("Failed to sync timeshift ring-buffer !");
+    if(reader->trickPlayRate != 0) {
+        if(!readTrickPlay(reader, &view)) {
+            return false;
         }
 
-        m_lastSyncTime = now;
+        consumer(view);
+        releasePages(reader, lock);
+        return true;
+    }
+
+    if(keyFrameMode) {
+        seekNextKeyFrame(reader);
+    }
+
+    if(!internalRead(reader, &view)) {
+        return false;
     }
 
-    delete p;
-    return success;
+    consumer(view);
+    releasePages(reader, lock);
+    return true;
 }
 
-void LiveQueue::close() {
-    ::close(m_readFd);
-    ::close(m_writeFd);
+bool LiveQueue::internalRead(Reader* reader, PacketView* view) {
+    if(m_readFd == -1) {
+        return false;
+    }
 
-    if(*m_storage) {
-        unlink(m_storage);
+    // check if read position wrapped
+    // (reached the end of the data written in the previous lap)
+
+    if(reader->wrapped && reader->readPosition >= m_wrapPosition) {
+        isyslog("timeshift: read buffer wrap");
+        resetReadPosition(reader, 0);
+        reader->wrapped = false;
+        isyslog("wrapped: %s", reader->wrapped ? "yes" : "no");
     }
-}
 
-void LiveQueue::trim(off_t position) {
-    if(!m_hasWrapped || m_indexList.empty()) {
-        return;
+    // check if read position is still behind write position (if not wrapped))
+    // if not -> skip packet (as we would start reading from the beginning of
+    // the buffer)
+
+    if(reader->readPosition >= m_writePosition && !reader->wrapped) {
+        return false;
     }
 
-    auto p = m_indexList.front();
+    uint32_t length = 0;
+    bool live = readLiveRecord(reader, view, length);
 
-    if(p.filePosition < position && p.wrapCount < m_wrapCount) {
-        m_indexList.pop_front();
+    // read packet from storage
+    if(!live && !readRecord(reader, view, length)) {
+        return false;
     }
 
-    if(!m_indexList.empty()) {
-        auto p = m_indexList.front();
-        m_queueStartTime = p.wallclockTime;
+    reader->readPosition += length;
+    releaseStorage(reader);
+
+    if(live) {
+        reader->liveReadCount++;
+    }
+    else {
+        reader->storageReadCount++;
     }
+
+    return true;
 }
 
-bool LiveQueue::pause(bool on) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+bool LiveQueue::readLiveRecord(Reader* reader, PacketView* view, uint32_t& length) {
+    // lap of the reader
+    int wrapCount = reader->wrapped ? m_wrapCount - 1 : m_wrapCount;
+
+    // find the record at the read position
+    auto i = std::lower_bound(m_liveCache.begin(), m_liveCache.end(), reader->readPosition,
+        [&](const LiveRecord& r, off_t position) {
+            return r.wrapCount < wrapCount || (r.wrapCount == wrapCount && r.filePosition < position);
+        });
+
+    // reader not at the live edge ?
+    if(i == m_liveCache.end()) {
+        return false;
+    }
+
+    const LiveRecord& r = *i;
 
-    if(m_pause == on) {
+    if(r.wrapCount != wrapCount || r.filePosition != reader->readPosition) {
         return false;
     }
 
-    m_pause = on;
+    MsgPacket* p = r.p.get();
+    length = TimeShiftRecord::HeaderLength + p->getPayloadLength();
+
+    if(view != nullptr) {
+        view->msgId = p->getMsgID();
+        view->clientId = p->getClientID();
+        view->payload = p->getPayload();
+        view->length = p->getPayloadLength();
+        view->packet = r.p;
+    }
+
     return true;
 }
 
-void LiveQueue::setTimeShiftDir(const cString& dir) {
-    m_timeShiftDir = dir;
-    dsyslog("TIMESHIFTDIR: %s", (const char*)m_timeShiftDir);
+void LiveQueue::releaseLiveRecord(const LiveRecord& r) {
+    m_liveCacheLength -= TimeShiftRecord::HeaderLength + r.p->getPayloadLength();
 }
 
-void LiveQueue::setBufferSize(uint64_t s) {
-    m_bufferSize = s;
-    isyslog("timeshift buffersize: %lu bytes", m_bufferSize);
+void LiveQueue::clearLiveCache() {
+    m_liveCache.clear();
+    m_liveCacheLength = 0;
 }
 
-void LiveQueue::removeTimeShiftFiles() {
-    DIR* dir = opendir((const char*)m_timeShiftDir);
+bool LiveQueue::readRecord(Reader* reader, PacketView* view, uint32_t& length) {
+    TimeShiftRecord::Header header;
+    off_t position = reader->readPosition;
 
-    if(dir == NULL) {
-        return;
+    // get record header
+    uint8_t* data = fetchRecordData(reader, position, TimeShiftRecord::HeaderLength);
+
+    if(data == nullptr) {
+        return false;
     }
 
-    struct dirent* entry = NULL;
+    TimeShiftRecord::decode(data, header);
+    length = TimeShiftRecord::recordLength(header);
 
-    while((entry = readdir(dir)) != NULL) {
-        if(strncmp(entry->d_name, "robotv-ringbuffer-", 16) == 0) {
-            isyslog("Removing old time-shift storage: %s", entry->d_name);
-            unlink(AddDirectory(m_timeShiftDir, entry->d_name));
-        }
+    if(position + (off_t)length > m_storageLength) {
+        esyslog("invalid record in timeshift ringbuffer");
+        return false;
+    }
+
+    if(view == nullptr) {
+        return true;
+    }
+
+    // get complete record
+    data = fetchRecordData(reader, position, length);
+
+    if(data == nullptr) {
+        return false;
     }
 
-    closedir(dir);
+    view->msgId = header.msgId;
+    view->clientId = header.clientId;
+    view->payload = data + TimeShiftRecord::HeaderLength;
+    view->length = header.length;
+
+    return true;
 }
 
-int64_t LiveQueue::seek(int64_t wallclockPositionMs) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+uint8_t* LiveQueue::fetchRecordData(Reader* reader, off_t position, uint32_t length) {
 
-    isyslog("seek: %lu", wallclockPositionMs);
+    // memory mapped ringbuffer -> point directly into the mapping
+    if(m_map != nullptr) {
+        if(position + (off_t)length > m_storageLength) {
+            return nullptr;
+        }
 
-    auto s = m_indexList.rbegin();
-    auto e = m_indexList.rend();
-    auto h = m_indexList.begin();
+        return m_map + position;
+    }
 
-    if(s == e) {
-        esyslog("empty timeshift queue - unable to seek");
-        return 0;
+    std::vector<uint8_t>& buffer = reader->readBuffer;
+
+    // already in read buffer ?
+    if(position >= reader->readBufferPosition && position + (off_t)length <= reader->readBufferPosition + (off_t)reader->readBufferLength) {
+        return buffer.data() + (position - reader->readBufferPosition);
     }
 
-    // ahead of buffer
-    if(wallclockPositionMs >= s->wallclockTime.count()) {
-        lseek(m_readFd, s->filePosition, SEEK_SET);
-        return s->pts;
+    // read ahead up to the end of the data available for the reader
+    // (data beyond that point may still change)
+    off_t dataEnd = reader->wrapped ? m_wrapPosition : m_writePosition;
+    off_t fillLength = std::min<off_t>(std::max<off_t>(length, (off_t)readBufferSize), dataEnd - position);
+
+    if(fillLength < (off_t)length) {
+        return nullptr;
     }
 
-    // behind buffer
-    else if(wallclockPositionMs <= h->wallclockTime.count()) {
-        lseek(m_readFd, h->filePosition, SEEK_SET);
-        return h->pts;
+    if(buffer.size() < (size_t)fillLength) {
+        buffer.resize(fillLength);
     }
 
-    // in between ?
-    while(s != e) {
-        if(s->wallclockTime.count() <= wallclockPositionMs) {
-            lseek(m_readFd, s->filePosition, SEEK_SET);
-            return s->pts;
-        }
+    ssize_t rc = pread(m_readFd, buffer.data(), fillLength, position);
 
-        s++;
+    if(rc < (ssize_t)length) {
+        reader->readBufferLength = 0;
+        return nullptr;
     }
 
-    // not found
-    esyslog("fileposition not found!");
-    return 0;
+    reader->readBufferPosition = position;
+    reader->readBufferLength = rc;
+
+    return buffer.data();
 }
 
-void LiveQueue::seekNextKeyFrame() {
-    off_t readPosition = lseek(m_readFd, 0, SEEK_CUR);
+bool LiveQueue::writeRecords(off_t position) {
+    if(m_writeVector.empty()) {
+        return true;
+    }
+
+    // memory mapped ringbuffer -> copy the records into the mapping
+    if(m_map != nullptr) {
+        for(const auto& iov : m_writeVector) {
+            memcpy(m_map + position, iov.iov_base, iov.iov_len);
+            position += iov.iov_len;
+        }
+
+        m_writeVector.clear();
+        return true;
+    }
 
-    auto i = m_indexList.begin();
-    auto j = i;
+    struct iovec* iov = m_writeVector.data();
+    int count = (int)m_writeVector.size();
+    uint64_t syscalls = 0;
 
-    while(i != m_indexList.end()) {
-        j++;
+    // write all pending records with a single syscall
+    // (continue with the remaining data on partial writes)
+    while(count > 0) {
+        ssize_t rc = pwritev(m_writeFd, iov, count, position);
+        syscalls++;
 
-        if(j == m_indexList.end()) {
-            return;
+        if(rc == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            break;
+        }
+
+        position += rc;
+
+        while(count > 0 && (size_t)rc >= iov->iov_len) {
+            rc -= iov->iov_len;
+            iov++;
+            count--;
+        }
+
+        if(count > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + rc;
+            iov->iov_len -= rc;
+        }
+    }
+
+    m_writeVector.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutexStatistics);
+        m_statistics.writeCount += syscalls;
+    }
+
+    return (count == 0);
+}
+
+void LiveQueue::rollbackRecords(off_t runStart) {
+    esyslog("Unable to write packets into timeshift ringbuffer !");
+
+    // remove keyframes pointing into the failed run
+    while(!m_indexList.empty()) {
+        const KeyFrameIndex::Entry& i = m_indexList.back();
+
+        if(i.wrapCount != m_wrapCount || i.filePosition < runStart) {
+            break;
         }
 
-        if(i->filePosition < readPosition && readPosition <= j->filePosition) {
-            readPosition = j->filePosition;
+        m_indexList.pop_back();
+    }
+
+    // remove records of the failed run from the live cache
+    while(!m_liveCache.empty()) {
+        const LiveRecord& r = m_liveCache.back();
+
+        if(r.wrapCount != m_wrapCount || r.filePosition < runStart) {
             break;
         }
 
-        i++;
+        releaseLiveRecord(r);
+        m_liveCache.pop_back();
+    }
+
+    // clients which already moved to one of these keyframes
+    for(auto reader : m_readers) {
+        if(!reader->wrapped && reader->readPosition > runStart) {
+            resetReadPosition(reader, runStart);
+        }
+    }
+}
+
+void LiveQueue::releaseStorage(Reader* reader) {
+    // pages may still be needed by other clients
+    if(m_readers.size() > 1) {
+        return;
+    }
+
+    // drop pages already consumed by the reader
+    static const off_t releaseChunk = 4 * 1024 * 1024;
+    off_t end = reader->readPosition & ~(releaseChunk - 1);
+
+    if(end - reader->releasePosition < releaseChunk) {
+        return;
+    }
+
+    reader->releaseEnd = end;
+}
+
+void LiveQueue::releasePages(Reader* reader, std::unique_lock<std::mutex>& lock) {
+    off_t start = reader->releasePosition;
+    off_t end = reader->releaseEnd;
+
+    if(end <= start) {
+        return;
+    }
+
+    reader->releasePosition = end;
+    uint8_t* map = m_map;
+    int fd = m_readFd;
+
+    // don't block the writer and other readers
+    // (the ringbuffer stays open and mapped until the queue is destroyed)
+    lock.unlock();
+
+    if(map != nullptr) {
+        madvise(map + start, end - start, MADV_DONTNEED);
+    }
+    else {
+        posix_fadvise(fd, start, end - start, POSIX_FADV_DONTNEED);
+    }
+}
+
+bool LiveQueue::allocateStorage(off_t end) {
+    while(m_allocatedLength < end) {
+        off_t length = std::min<off_t>((off_t)segmentSize, m_storageLength - m_allocatedLength);
+        int rc = posix_fallocate(m_writeFd, m_allocatedLength, length);
+
+        if(rc != 0) {
+            esyslog("unable to allocate %li bytes for timeshift ringbuffer: %s", (long)length, strerror(rc));
+            return false;
+        }
+
+        m_allocatedLength += length;
+    }
+
+    return true;
+}
+
+void LiveQueue::releaseSegments(off_t position) {
+    // first complete segment behind the position
+    off_t start = ((position + segmentSize - 1) / segmentSize) * segmentSize;
+
+    if(start >= m_allocatedLength) {
+        return;
+    }
+
+    m_punchStart = (m_punchEnd > m_punchStart) ? std::min(m_punchStart, start) : start;
+    m_punchEnd = std::max<off_t>(m_punchEnd, m_allocatedLength);
+    m_allocatedLength = start;
+}
+
+void LiveQueue::punchSegments() {
+    if(m_punchEnd <= m_punchStart) {
+        return;
+    }
+
+    if(fallocate(m_writeFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, m_punchStart, m_punchEnd - m_punchStart) != 0) {
+        dsyslog("unable to release timeshift storage: %s", strerror(errno));
+    }
+    else {
+        dsyslog("released %li bytes of timeshift storage", (long)(m_punchEnd - m_punchStart));
+    }
+
+    m_punchStart = 0;
+    m_punchEnd = 0;
+}
+
+off_t LiveQueue::getPendingStorage() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // ringbuffer not created yet
+    if(m_writeFd == -1) {
+        return (off_t)m_bufferSize + 1024 * 1024;
+    }
+
+    return m_storageLength - m_allocatedLength;
+}
+
+bool LiveQueue::isPaused(Reader* reader) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return reader->pause;
+}
+
+void LiveQueue::queue(Reader* reader, MsgPacket* p, StreamInfo::Content content, int64_t pts) {
+    queue(reader, std::shared_ptr<MsgPacket>(p), content, pts);
+}
+
+void LiveQueue::queue(Reader* reader, const std::shared_ptr<MsgPacket>& p, StreamInfo::Content content, int64_t pts) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutexQueue);
+
+        if(reader != m_writer || !acceptPacket(p.get(), content, pts)) {
+            return;
+        }
+
+        start();
+
+        if(!enqueue({p, content, pts, std::chrono::steady_clock::now()})) {
+            return;
+        }
+    }
+
+    m_writerCondition.notify_one();
+}
+
+bool LiveQueue::isWriter(Reader* reader) {
+    std::lock_guard<std::mutex> lock(m_mutexQueue);
+    return reader == m_writer;
+}
+
+static StreamInfo::FrameType frameType(const LiveQueue::PacketData& data) {
+    if(data.content != StreamInfo::Content::VIDEO) {
+        return StreamInfo::FrameType::UNKNOWN;
+    }
+
+    // frame type is stored in the client id of stream packets
+    return (StreamInfo::FrameType)data.p->getClientID();
+}
+
+static bool isNonReferenceFrame(const LiveQueue::PacketData& data) {
+    StreamInfo::FrameType type = frameType(data);
+    return (type == StreamInfo::FrameType::BFRAME || type == StreamInfo::FrameType::DFRAME);
+}
+
+// subtitles, teletext and other packets without decoding dependencies
+static bool isOtherPacket(const LiveQueue::PacketData& data) {
+    return (data.content != StreamInfo::Content::VIDEO &&
+            data.content != StreamInfo::Content::AUDIO &&
+            data.content != StreamInfo::Content::STREAMINFO);
+}
+
+bool LiveQueue::enqueue(const PacketData& data) {
+    bool video = (data.content == StreamInfo::Content::VIDEO);
+    bool keyFrame = (frameType(data) == StreamInfo::FrameType::IFRAME);
+
+    // a reference frame has been dropped -> skip video up to the next keyframe
+    if(video && m_dropUntilKeyFrame) {
+        if(!keyFrame) {
+            countDrop(&Statistics::droppedReference);
+            return false;
+        }
+
+        m_dropUntilKeyFrame = false;
+    }
+
+    // stream information is never dropped (it may exceed the limit)
+    if(m_writerQueue.size() < maxQueueSize || data.content == StreamInfo::Content::STREAMINFO) {
+        m_writerQueue.push_back(data);
+        return true;
+    }
+
+    countDrop(&Statistics::overflowCount);
+
+    // 1. non-reference frames
+    if(isNonReferenceFrame(data)) {
+        countDrop(&Statistics::droppedNonReference);
+        return false;
+    }
+
+    if(dropNonReferenceFrame()) {
+        m_writerQueue.push_back(data);
+        return true;
+    }
+
+    // 2. subtitles, teletext and other packets without decoding dependencies
+    if(isOtherPacket(data)) {
+        countDrop(&Statistics::droppedOther);
+        return false;
+    }
+
+    if(dropOtherPacket()) {
+        m_writerQueue.push_back(data);
+        return true;
+    }
+
+    // 3. reference frames (and the following frames up to the next keyframe)
+    if(video && !keyFrame) {
+        countDrop(&Statistics::droppedReference);
+        m_dropUntilKeyFrame = true;
+        return false;
+    }
+
+    // 4. keyframes and audio (only if nothing less important is queued)
+    if(!dropReferenceFrame()) {
+        if(keyFrame) {
+            countDrop(&Statistics::droppedReference);
+            m_dropUntilKeyFrame = true;
+        }
+        else {
+            uint64_t count = countDrop(&Statistics::droppedAudio);
+
+            if(count % 100 == 1) {
+                esyslog("timeshift queue %s: writer queue full of keyframes and audio - %lu audio packets dropped", m_id.c_str(), count);
+            }
+        }
+
+        return false;
+    }
+
+    // a keyframe starts a new GOP
+    if(keyFrame) {
+        m_dropUntilKeyFrame = false;
+    }
+
+    m_writerQueue.push_back(data);
+    return true;
+}
+
+bool LiveQueue::dropNonReferenceFrame() {
+    for(auto i = m_writerQueue.begin(); i != m_writerQueue.end(); i++) {
+        if(isNonReferenceFrame(*i)) {
+            m_writerQueue.erase(i);
+            countDrop(&Statistics::droppedNonReference);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool LiveQueue::dropOtherPacket() {
+    for(auto i = m_writerQueue.begin(); i != m_writerQueue.end(); i++) {
+        if(isOtherPacket(*i)) {
+            m_writerQueue.erase(i);
+            countDrop(&Statistics::droppedOther);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool LiveQueue::dropReferenceFrame() {
+    bool keyFrameQueued = false;
+
+    // the newest queued frame depending on previous frames
+    // (no queued frame depends on it)
+    for(auto i = m_writerQueue.end(); i != m_writerQueue.begin();) {
+        i--;
+
+        if(i->content != StreamInfo::Content::VIDEO) {
+            continue;
+        }
+
+        if(frameType(*i) == StreamInfo::FrameType::IFRAME) {
+            keyFrameQueued = true;
+            continue;
+        }
+
+        m_writerQueue.erase(i);
+        countDrop(&Statistics::droppedReference);
+
+        // following frames can't be decoded up to the next keyframe
+        if(!keyFrameQueued) {
+            m_dropUntilKeyFrame = true;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+uint64_t LiveQueue::countDrop(uint64_t Statistics::* counter) {
+    std::lock_guard<std::mutex> lock(m_mutexStatistics);
+    return ++(m_statistics.*counter);
+}
+
+void LiveQueue::countLockTime(std::chrono::steady_clock::time_point locked) {
+    auto holdTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - locked);
+    std::lock_guard<std::mutex> lock(m_mutexStatistics);
+
+    m_statistics.lockCount++;
+    m_statistics.lockHoldSum += holdTime;
+
+    if(holdTime > m_statistics.lockHoldMax) {
+        m_statistics.lockHoldMax = holdTime;
+    }
+}
+
+bool LiveQueue::acceptPacket(MsgPacket* p, StreamInfo::Content content, int64_t pts) {
+    // writer changed -> continue where the previous writer stopped
+    // (video at the next keyframe, audio only streams at the next audio packet)
+    if(m_resync) {
+        bool keyFrame = (p->getClientID() == (uint16_t)StreamInfo::FrameType::IFRAME);
+
+        if(m_hasVideo) {
+            m_resync = !(content == StreamInfo::Content::VIDEO && keyFrame && pts > m_lastVideoPts);
+        }
+        else {
+            m_resync = !(content == StreamInfo::Content::AUDIO && pts > m_lastAudioPts);
+        }
+
+        if(m_resync) {
+            return false;
+        }
+
+        isyslog("timeshift queue %s: writer changed", m_id.c_str());
+    }
+
+    if(content == StreamInfo::Content::VIDEO) {
+        m_hasVideo = true;
+        m_lastVideoPts = pts;
+    }
+    else if(content == StreamInfo::Content::AUDIO) {
+        m_lastAudioPts = std::max(m_lastAudioPts, pts);
+    }
+
+    return true;
+}
+
+void LiveQueue::send(Reader* reader, MsgPacket* p) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    reader->packets.push_back(p);
+    m_readCondition.notify_all();
+}
+
+bool LiveQueue::waitForData(Reader* reader, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    return m_readCondition.wait_for(lock, timeout, [&]() {
+        return isReadable(reader);
+    });
+}
+
+bool LiveQueue::isReadable(Reader* reader) {
+    if(reader->pause) {
+        return false;
+    }
+
+    return !reader->packets.empty() || reader->wrapped || reader->readPosition < m_writePosition;
+}
+
+void LiveQueue::write(std::deque<PacketData>& batch) {
+    auto timeStamp = roboTV::currentTimeMillis();
+    auto next = batch.begin();
+
+    // record headers must stay in place until the run is written
+    m_recordHeaders.reserve(batch.size());
+
+    while(next != batch.end()) {
+        off_t runStart = 0;
+        off_t runEnd = 0;
+
+        // prepare the next run of records
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto locked = std::chrono::steady_clock::now();
+
+            next = stageRecords(batch, next, timeStamp, runEnd);
+
+            // a run starts at the published position (or at the start of a new lap)
+            runStart = m_writePosition;
+            countLockTime(locked);
+        }
+
+        // storage released by a wrap
+        punchSegments();
+
+        // write the run without holding the lock
+        // (readers don't see the records before they are published)
+        bool written = writeRecords(runStart);
+        m_recordHeaders.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto locked = std::chrono::steady_clock::now();
+
+            if(written) {
+                m_writePosition = runEnd;
+                m_readCondition.notify_all();
+            }
+            else {
+                rollbackRecords(runStart);
+            }
+
+            countLockTime(locked);
+        }
+
+        if(!written) {
+            break;
+        }
+
+        // allocate the next segment before the writer needs it
+        allocateStorage(std::min<off_t>(runEnd + (off_t)segmentSize, m_storageLength));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto locked = std::chrono::steady_clock::now();
+
+        // limit the live cache (a reader behind it reads from storage)
+        while(m_liveCacheLength > m_liveCacheSize && !m_liveCache.empty()) {
+            const LiveRecord& r = m_liveCache.front();
+            releaseLiveRecord(r);
+            m_liveCache.pop_front();
+        }
+
+        // schedule writeback of completed windows
+        // (done by the writer thread without holding the lock)
+        while(m_writePosition - m_syncPosition >= writebackWindow) {
+            addWriteback(m_syncPosition, writebackWindow);
+            m_syncPosition += writebackWindow;
+        }
+
+        countLockTime(locked);
+    }
+}
+
+std::deque<LiveQueue::PacketData>::iterator LiveQueue::stageRecords(std::deque<PacketData>& batch, std::deque<PacketData>::iterator i, std::chrono::milliseconds timeStamp, off_t& runEnd) {
+    off_t position = m_writePosition;
+
+    for(; i != batch.end(); i++) {
+        PacketData& data = *i;
+        MsgPacket* p = data.p.get();
+
+        // first packet set start time
+        if(m_indexList.empty()) {
+            m_queueStartTime = roboTV::currentTimeMillis();
+        }
+
+        // ring-buffer overrun ?
+
+        uint32_t packetLength = TimeShiftRecord::HeaderLength + p->getPayloadLength();
+
+        if((off_t)packetLength > m_storageLength) {
+            esyslog("packet too large for timeshift ringbuffer (%u bytes)", packetLength);
+            continue;
+        }
+
+        if(position >= (off_t)m_bufferLimit || position + (off_t)packetLength > m_storageLength) {
+
+            // the current lap must be complete on disk before the reader may wrap
+            if(position != m_writePosition) {
+                break;
+            }
+
+            isyslog("timeshift: write buffer wrap");
+
+            // writeback the rest of the lap
+            addWriteback(m_syncPosition, m_writePosition - m_syncPosition);
+            m_syncPosition = 0;
+
+            // reader still in the previous lap ?
+            // -> this lap will be overwritten, continue with the lap we just finished
+            for(auto reader : m_readers) {
+                if(reader->wrapped) {
+                    resetReadPosition(reader, 0);
+                }
+
+                reader->wrapped = true;
+            }
+
+            m_wrapPosition = m_writePosition;
+            m_writePosition = 0;
+            position = 0;
+
+            // storage beyond the end of the lap isn't used anymore
+            releaseSegments(m_wrapPosition);
+
+            m_hasWrapped = true;
+            m_wrapCount++;
+        }
+
+        off_t writePosition = position;
+        off_t packetEndPosition = writePosition + packetLength;
+
+        // released storage must be punched out before it is allocated again
+        if(m_punchEnd > m_punchStart && packetEndPosition > m_punchStart) {
+            break;
+        }
+
+        // allocate storage for the next segment
+        if(!allocateStorage(packetEndPosition)) {
+
+            // a mapping needs backing storage
+            if(m_map != nullptr) {
+                i = batch.end();
+                break;
+            }
+
+            // files grow on write
+            isyslog("continuing without pre-allocated timeshift storage");
+            m_allocatedLength = m_storageLength;
+        }
+
+        // check if write position if still behind read position (if wrapped)
+        // if not -> shift read position forward
+
+        for(auto reader : m_readers) {
+            if(packetEndPosition >= reader->readPosition && reader->wrapped) {
+                skipOverrun(reader, packetEndPosition);
+            }
+        }
+
+        trim(packetEndPosition);
+
+        // add keyframe to map
+        // (every record has its own position, even if written in one go)
+        bool keyFrame = (p->getClientID() == (uint16_t)StreamInfo::FrameType::IFRAME);
+
+        if(keyFrame && data.content == StreamInfo::Content::VIDEO) {
+            m_indexList.push_back({writePosition, timeStamp, data.pts, m_wrapCount});
+        }
+
+        // keep the current stream information for joining clients
+        if(data.content == StreamInfo::Content::STREAMINFO) {
+            m_streamInfo = data.p;
+        }
+
+        // queue record for the vectored write / copy into the mapping
+        m_recordHeaders.push_back({});
+        TimeShiftRecord::Header& header = m_recordHeaders.back();
+        TimeShiftRecord::encode(p, header);
+
+        m_writeVector.push_back({&header, TimeShiftRecord::HeaderLength});
+
+        if(header.length > 0) {
+            m_writeVector.push_back({p->getPayload(), header.length});
+        }
+
+        position = packetEndPosition;
+        m_bitRateBytes += packetLength;
+
+        // keep the packet in memory for a reader at the live edge
+        if(m_map == nullptr && m_liveCacheSize > 0) {
+            m_liveCache.push_back({writePosition, m_wrapCount, data.p});
+            m_liveCacheLength += packetLength;
+        }
+
+        if(m_writeVector.size() >= IOV_MAX - 1) {
+            i++;
+            break;
+        }
+    }
+
+    runEnd = position;
+    return i;
+}
+
+void LiveQueue::close() {
+    if(m_map != nullptr) {
+        munmap(m_map, m_storageLength);
+        m_map = nullptr;
+    }
+
+    ::close(m_readFd);
+
+    // keep the file (and its first segment) for the next queue
+    bool recycled = false;
+
+    if(*m_storage && m_writeFd != -1) {
+        releaseSegments(segmentSize);
+        punchSegments();
+        recycled = returnPoolFile(m_storageDir, (const char*)m_storage);
+    }
+
+    ::close(m_writeFd);
+
+    m_readFd = -1;
+    m_writeFd = -1;
+
+    if(*m_storage && !recycled) {
+        unlink(m_storage);
+    }
+}
+
+void LiveQueue::trim(off_t position) {
+    if(!m_hasWrapped || m_indexList.empty()) {
+        return;
+    }
+
+    // drop all keyframes overwritten by this write
+    m_indexList.trim(m_wrapCount, position);
+
+    if(!m_indexList.empty()) {
+        m_queueStartTime = m_indexList.front().wallclockTime;
+    }
+}
+
+bool LiveQueue::pause(Reader* reader, bool on) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if(reader->pause == on) {
+        return false;
+    }
+
+    reader->pause = on;
+    m_readCondition.notify_all();
+
+    // continue trick play at the last keyframe delivered
+    if(!on && reader->trickPlayRate != 0 && reader->trickPlayLast != -1) {
+        reader->trickPlayTime = reader->trickPlayLast;
+        reader->trickPlayStart = std::chrono::steady_clock::now();
+    }
+
+    return true;
+}
+
+int64_t LiveQueue::trickPlay(Reader* reader, int rate) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if(rate != 0) {
+        rate = std::max(-64, std::min(64, rate));
+
+        if(rate > -2 && rate < 2) {
+            rate = (rate < 0) ? -2 : 2;
+        }
+    }
+
+    isyslog("trick play: %ix", rate);
+
+    if(m_indexList.empty()) {
+        reader->trickPlayRate = 0;
+        return 0;
+    }
+
+    const KeyFrameIndex::Entry& e = m_indexList[currentKeyFrame(reader)];
+
+    // trick play starts at the keyframe of the current position
+    reader->trickPlayRate = rate;
+    reader->trickPlayTime = e.wallclockTime.count();
+    reader->trickPlayLast = -1;
+    reader->trickPlayStart = std::chrono::steady_clock::now();
+
+    return e.pts;
+}
+
+int LiveQueue::getTrickPlayRate(Reader* reader) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return reader->trickPlayRate;
+}
+
+bool LiveQueue::readTrickPlay(Reader* reader, PacketView* view) {
+    if(m_indexList.empty()) {
+        return false;
+    }
+
+    // stream position due at the current time
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - reader->trickPlayStart).count();
+
+    int64_t target = reader->trickPlayTime + elapsed * reader->trickPlayRate;
+
+    // reached the live edge -> continue with normal playback at the last keyframe
+    if(reader->trickPlayRate > 0 && target >= m_indexList.back().wallclockTime.count()) {
+        isyslog("trick play: reached live position");
+        setReadPosition(reader, m_indexList.back());
+        reader->trickPlayRate = 0;
+        return internalRead(reader, view);
+    }
+
+    // reached the start of the buffer -> continue with normal playback there
+    if(reader->trickPlayRate < 0 && target <= m_indexList.front().wallclockTime.count()) {
+        isyslog("trick play: reached start of timeshift buffer");
+        setReadPosition(reader, m_indexList.front());
+        reader->trickPlayRate = 0;
+        return internalRead(reader, view);
+    }
+
+    // keyframe at or before the target position
+    const KeyFrameIndex::Entry& e = m_indexList[m_indexList.findTime(target)];
+
+    // already delivered ?
+    if(e.wallclockTime.count() == reader->trickPlayLast) {
+        return false;
+    }
+
+    setReadPosition(reader, e);
+
+    if(!internalRead(reader, view)) {
+        return false;
+    }
+
+    reader->trickPlayLast = e.wallclockTime.count();
+    return true;
+}
+
+void LiveQueue::setTimeShiftDir(const cString& dir) {
+    std::string list = (const char*)dir;
+    m_timeShiftDirs.clear();
+
+    // comma separated list of directories
+    size_t start = 0;
+
+    while(start <= list.size()) {
+        size_t end = list.find(',', start);
+
+        if(end == std::string::npos) {
+            end = list.size();
+        }
+
+        std::string path = list.substr(start, end - start);
+        path.erase(0, path.find_first_not_of(" \t"));
+        path.erase(path.find_last_not_of(" \t") + 1);
+
+        if(!path.empty()) {
+            m_timeShiftDirs.push_back(path);
+            dsyslog("TIMESHIFTDIR: %s", path.c_str());
+        }
+
+        start = end + 1;
+    }
+}
+
+std::string LiveQueue::selectTimeShiftDir() {
+    if(m_timeShiftDirs.size() == 1) {
+        return m_timeShiftDirs.front();
+    }
+
+    std::string best;
+    uint64_t bestBitRate = 0;
+    uint64_t bestFree = 0;
+    bool bestFits = false;
+
+    for(const auto& dir : m_timeShiftDirs) {
+        struct statvfs st;
+
+        if(statvfs(dir.c_str(), &st) != 0) {
+            esyslog("timeshift directory %s not available: %s", dir.c_str(), strerror(errno));
+            continue;
+        }
+
+        uint64_t free = (uint64_t)st.f_bavail * st.f_frsize;
+
+        // current write bandwidth of the directory
+        // (and the space the sparse files of its queues will still take)
+        uint64_t bitRate = 0;
+        uint64_t pending = 0;
+
+        for(const auto& i : m_queues) {
+            if(i.second->m_storageDir == dir) {
+                uint64_t queueBitRate = i.second->m_bitRate;
+                bitRate += (queueBitRate == 0) ? defaultBitRate : queueBitRate;
+                pending += i.second->getPendingStorage();
+            }
+        }
+
+        free = (free > pending) ? free - pending : 0;
+        bool fits = (free >= m_bufferSize);
+
+        // prefer directories with enough free space,
+        // then the lowest write bandwidth, then the most free space
+        bool better =
+            best.empty() ||
+            (fits && !bestFits) ||
+            (fits == bestFits && (bitRate < bestBitRate || (bitRate == bestBitRate && free > bestFree)));
+
+        if(better) {
+            best = dir;
+            bestBitRate = bitRate;
+            bestFree = free;
+            bestFits = fits;
+        }
+    }
+
+    if(best.empty()) {
+        best = m_timeShiftDirs.front();
+    }
+
+    dsyslog("timeshift storage on %s (%lu kbit/s, %lu MB free)", best.c_str(), bestBitRate * 8 / 1000, bestFree / (1024 * 1024));
+    return best;
+}
+
+void LiveQueue::setBufferSize(uint64_t s) {
+    m_bufferSize = s;
+    isyslog("timeshift buffersize: %lu bytes", m_bufferSize);
+}
+
+void LiveQueue::setTotalBufferSize(uint64_t s) {
+    m_totalBufferSize = s;
+    isyslog("timeshift total buffersize: %lu bytes", m_totalBufferSize);
+}
+
+void LiveQueue::setMaxBufferTime(int minutes) {
+    m_maxBufferTime = minutes;
+    isyslog("timeshift buffer time: %i minutes", m_maxBufferTime);
+}
+
+void LiveQueue::setStorageMode(StorageMode mode) {
+    m_storageMode = mode;
+    isyslog("timeshift storage: %s", mode == StorageMode::MMAP ? "memory mapped" : "file");
+}
+
+void LiveQueue::setLiveCacheSize(uint64_t s) {
+    m_liveCacheSize = s;
+    isyslog("timeshift live cache: %lu bytes", m_liveCacheSize);
+}
+
+void LiveQueue::removeTimeShiftFiles() {
+    for(const auto& path : m_timeShiftDirs) {
+        DIR* dir = opendir(path.c_str());
+
+        if(dir == NULL) {
+            continue;
+        }
+
+        struct dirent* entry = NULL;
+
+        while((entry = readdir(dir)) != NULL) {
+            if(strncmp(entry->d_name, "robotv-ringbuffer-", 16) == 0) {
+                isyslog("Removing old time-shift storage: %s", entry->d_name);
+                unlink(AddDirectory(path.c_str(), entry->d_name));
+            }
+        }
+
+        closedir(dir);
+    }
+}
+
+void LiveQueue::setFilePoolSize(int count) {
+    m_filePoolSize = std::max(count, 0);
+    isyslog("timeshift file pool: %i files per directory", m_filePoolSize);
+}
+
+void LiveQueue::createFilePool() {
+    if(m_filePoolSize == 0 || m_poolThread != nullptr) {
+        return;
+    }
+
+    // preallocating the files may take a while on slow filesystems
+    m_poolRunning = true;
+    m_poolThread = new std::thread(fillFilePool);
+}
+
+void LiveQueue::fillFilePool() {
+    off_t storageLength = (off_t)m_bufferSize + 1024 * 1024;
+    off_t allocLength = std::min<off_t>((off_t)segmentSize, storageLength);
+    int created = 0;
+
+    for(const auto& dir : m_timeShiftDirs) {
+        while(m_poolRunning) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutexPool);
+
+                int count = std::count_if(m_filePool.begin(), m_filePool.end(), [&](const PoolFile& file) {
+                    return file.dir == dir;
+                });
+
+                if(count >= m_filePoolSize) {
+                    break;
+                }
+            }
+
+            int storageId = 0;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutexQueues);
+                storageId = m_nextStorageId++;
+            }
+
+            cString path = cString::sprintf("%s/robotv-ringbuffer-%05i.data", dir.c_str(), storageId);
+            int fd = open(path, O_CREAT | O_RDWR, 0644);
+
+            if(fd == -1) {
+                esyslog("unable to create timeshift file %s: %s", (const char*)path, strerror(errno));
+                break;
+            }
+
+            bool ok = (ftruncate(fd, storageLength) == 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, allocLength) == 0);
+
+            if(!ok) {
+                esyslog("unable to pre-allocate timeshift file %s: %s", (const char*)path, strerror(errno));
+            }
+
+            ::close(fd);
+
+            if(!ok) {
+                unlink(path);
+                break;
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutexPool);
+            m_filePool.push_back({dir, (const char*)path});
+            created++;
+        }
+    }
+
+    isyslog("timeshift file pool: %i files created", created);
+}
+
+void LiveQueue::destroyFilePool() {
+    if(m_poolThread != nullptr) {
+        m_poolRunning = false;
+        m_poolThread->join();
+
+        delete m_poolThread;
+        m_poolThread = nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutexPool);
+
+    for(const auto& file : m_filePool) {
+        unlink(file.path.c_str());
+    }
+
+    m_filePool.clear();
+}
+
+bool LiveQueue::takePoolFile(const std::string& dir, std::string& path) {
+    std::lock_guard<std::mutex> lock(m_mutexPool);
+
+    for(auto i = m_filePool.begin(); i != m_filePool.end(); i++) {
+        if(i->dir == dir) {
+            path = i->path;
+            m_filePool.erase(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool LiveQueue::returnPoolFile(const std::string& dir, const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_mutexPool);
+
+    int count = std::count_if(m_filePool.begin(), m_filePool.end(), [&](const PoolFile& file) {
+        return file.dir == dir;
+    });
+
+    if(count >= m_filePoolSize) {
+        return false;
+    }
+
+    m_filePool.push_back({dir, path});
+    return true;
+}
+
+int64_t LiveQueue::seek(Reader* reader, int64_t wallclockPositionMs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    isyslog("seek: %lu", wallclockPositionMs);
+
+    if(m_indexList.empty()) {
+        esyslog("empty timeshift queue - unable to seek");
+        return 0;
+    }
+
+    // last keyframe at or before the requested position
+    // (clamped to the start of the buffer)
+    const KeyFrameIndex::Entry& e = m_indexList[m_indexList.findTime(wallclockPositionMs)];
+
+    setReadPosition(reader, e);
+    reader->trickPlayRate = 0;
+    return e.pts;
+}
+
+void LiveQueue::resetReadPosition(Reader* reader, off_t position) {
+    reader->readPosition = position;
+    reader->releasePosition = 0;
+    reader->releaseEnd = 0;
+    reader->readBufferLength = 0;
+}
+
+void LiveQueue::setReadPosition(Reader* reader, const KeyFrameIndex::Entry& index) {
+    resetReadPosition(reader, index.filePosition);
+
+    // keyframe written in the previous lap of the writer ?
+    reader->wrapped = (index.wrapCount != m_wrapCount);
+}
+
+void LiveQueue::skipOverrun(Reader* reader, off_t position) {
+    // next keyframe of the previous lap behind the write window
+    size_t i = m_indexList.findPosition(m_wrapCount - 1, position + 1);
+
+    // no keyframe left in the previous lap -> continue in the current lap
+    if(i == m_indexList.size()) {
+        resetReadPosition(reader, 0);
+        reader->wrapped = false;
+    }
+    else {
+        setReadPosition(reader, m_indexList[i]);
+    }
+
+    reader->overrunCount++;
+}
+
+void LiveQueue::seekNextKeyFrame(Reader* reader) {
+    // lap of the reader
+    int wrapCount = reader->wrapped ? m_wrapCount - 1 : m_wrapCount;
+    size_t i = m_indexList.findPosition(wrapCount, reader->readPosition);
+
+    if(i == m_indexList.size()) {
+        return;
+    }
+
+    setReadPosition(reader, m_indexList[i]);
+}
+
+size_t LiveQueue::currentKeyFrame(Reader* reader) {
+    // lap of the reader
+    int wrapCount = reader->wrapped ? m_wrapCount - 1 : m_wrapCount;
+    size_t i = m_indexList.findPosition(wrapCount, reader->readPosition);
+
+    // exactly at a keyframe ?
+    if(i < m_indexList.size()) {
+        const KeyFrameIndex::Entry& e = m_indexList[i];
+
+        if(e.wrapCount == wrapCount && e.filePosition == reader->readPosition) {
+            return i;
+        }
     }
 
-    lseek(m_readFd, readPosition, SEEK_SET);
+    return (i > 0) ? i - 1 : 0;
 }
 
 int64_t LiveQueue::getTimeshiftStartPosition() {
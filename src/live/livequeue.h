@@ -26,57 +26,256 @@
 #define ROBOTV_LIVEQUEUE_H
 
 #include "robotvdmx/streaminfo.h"
+#include "keyframeindex.h"
+#include "timeshiftrecord.h"
+
+#include <sys/uio.h>
 
 #include <deque>
+#include <vector>
 #include <chrono>
 #include <mutex>
+#include <condition_variable>
 #include <list>
 #include <thread>
 #include <atomic>
+#include <functional>
+#include <memory>
+#include <map>
+#include <string>
 
 class MsgPacket;
 
 class LiveQueue {
 public:
 
-    LiveQueue(int socket);
+    enum class StorageMode {
+        FILE,
+        MMAP
+    };
 
-    virtual ~LiveQueue();
+    struct PacketView {
+        uint16_t msgId;
+        uint16_t clientId;
+        uint8_t* payload;
+        uint32_t length;
+        std::shared_ptr<MsgPacket> packet; // owner of the payload (if it may be kept)
+    };
+
+    typedef std::function<void(const PacketView& view)> PacketConsumer;
+
+    /**
+     * Read cursor of a single client.
+     * Every client has its own read position and pause state.
+     */
+    struct Reader {
+        int socket;
+        off_t readPosition = 0;
+        off_t releasePosition = 0;
+        off_t releaseEnd = 0;
+        bool wrapped = false;
+        bool pause = false;
+        std::vector<uint8_t> readBuffer;
+        off_t readBufferPosition = 0;
+        size_t readBufferLength = 0;
+        std::deque<MsgPacket*> packets;
+        uint64_t overrunCount = 0;
+        uint64_t liveReadCount = 0;
+        uint64_t storageReadCount = 0;
+        int trickPlayRate = 0;
+        int64_t trickPlayTime = 0;
+        int64_t trickPlayLast = -1;
+        std::chrono::steady_clock::time_point trickPlayStart;
+    };
 
-    void queue(MsgPacket* p, StreamInfo::Content content, int64_t pts = 0);
+    /**
+     * Attach a client to a shared queue.
+     * Clients using the same id share one timeshift buffer. The queue is
+     * created on first use.
+     * @param id queue id (channel and stream order)
+     * @param socket socket of the client
+     * @param reader receives the read cursor of the client
+     * @return the shared queue
+     */
+    static LiveQueue* attach(const std::string& id, int socket, Reader*& reader);
+
+    /**
+     * Detach a client from a shared queue.
+     * The queue is destroyed when the last client detached.
+     * @param queue shared queue
+     * @param reader read cursor of the client
+     */
+    static void detach(LiveQueue* queue, Reader* reader);
+
+    /**
+     * Put a packet into the timeshift buffer.
+     * Only the packets of the writing client are stored, packets of all
+     * other clients are dropped. If the writing client detaches, the next
+     * client takes over at the next keyframe.
+     * @param reader client delivering the packet
+     * @param p packet (ownership is taken over)
+     * @param content content of the packet
+     * @param pts presentation timestamp of the packet
+     */
+    void queue(Reader* reader, MsgPacket* p, StreamInfo::Content content, int64_t pts = 0);
+
+    /**
+     * Put a shared packet into the timeshift buffer.
+     * The packet may be queued to several queues at once, it must not be
+     * modified anymore.
+     * @param reader client delivering the packet
+     * @param p shared packet
+     * @param content content of the packet
+     * @param pts presentation timestamp of the packet
+     */
+    void queue(Reader* reader, const std::shared_ptr<MsgPacket>& p, StreamInfo::Content content, int64_t pts = 0);
+
+    /**
+     * Check if the packets of a client are stored.
+     * @param reader client delivering packets
+     * @return true if the client is the writer of the queue
+     */
+    bool isWriter(Reader* reader);
+
+    /**
+     * Send a packet to a single client.
+     * The packet doesn't go into the timeshift buffer.
+     * @param reader receiving client
+     * @param p packet (ownership is taken over)
+     */
+    void send(Reader* reader, MsgPacket* p);
+
+    /**
+     * Wait until a packet can be read by a client.
+     * @param reader read cursor of the client
+     * @param timeout maximum time to wait
+     * @return true if a packet is available
+     */
+    bool waitForData(Reader* reader, std::chrono::milliseconds timeout);
+
+    /**
+     * Read the next packet from the timeshift buffer.
+     * The view passed to the consumer is only valid during the callback.
+     * @param reader read cursor of the client
+     * @param consumer callback receiving the packet
+     * @param keyFrameMode skip to the next keyframe before reading
+     * @return true if a packet has been passed to the consumer
+     */
+    bool read(Reader* reader, const PacketConsumer& consumer, bool keyFrameMode = false);
+
+    int64_t seek(Reader* reader, int64_t wallclockPositionMs);
+
+    bool pause(Reader* reader, bool on = true);
+
+    bool isPaused(Reader* reader);
+
+    /**
+     * Start or stop trick play (fast forward / rewind) of a client.
+     * In trick play mode only the keyframes of the timeshift index are
+     * delivered. The stream position advances with the given rate in real
+     * time. Trick play ends at the start or the live edge of the buffer.
+     * @param reader read cursor of the client
+     * @param rate playback rate (2 to 64 or -2 to -64, 0 = normal playback)
+     * @return pts of the keyframe trick play starts at (or stopped at)
+     */
+    int64_t trickPlay(Reader* reader, int rate);
+
+    int getTrickPlayRate(Reader* reader);
 
-    MsgPacket* read(bool keyFrameMode = false);
+    static void setTimeShiftDir(const cString& dir);
 
-    int64_t seek(int64_t wallclockPositionMs);
+    static void setBufferSize(uint64_t s);
 
-    bool pause(bool on = true);
+    /**
+     * Set the timeshift budget of all clients.
+     * The budget is split among all queues by their bitrate (0 = no limit).
+     * @param s total buffer size in bytes
+     */
+    static void setTotalBufferSize(uint64_t s);
 
-    bool isPaused();
+    /**
+     * Set the maximum timeshift time.
+     * Limits the buffer of each queue to the given time at its bitrate (0 = no limit).
+     * @param minutes buffer time in minutes
+     */
+    static void setMaxBufferTime(int minutes);
 
-    static void setTimeShiftDir(const cString& dir);
+    static void setStorageMode(StorageMode mode);
 
-    static void setBufferSize(uint64_t s);
+    static void setLiveCacheSize(uint64_t s);
 
     static void removeTimeShiftFiles();
 
+    /**
+     * Set the number of spare timeshift files kept per directory.
+     * @param count files per timeshift directory (0 = no pool)
+     */
+    static void setFilePoolSize(int count);
+
+    /**
+     * Create the pool of spare timeshift files.
+     * Every file is sized and has its first storage segment allocated,
+     * so opening a channel does not have to wait for the filesystem.
+     * The files are created by a background thread (the function returns immediately).
+     */
+    static void createFilePool();
+
+    /**
+     * Stop filling the pool and remove all spare timeshift files.
+     */
+    static void destroyFilePool();
+
     int64_t getTimeshiftStartPosition();
 
+    // maximum number of packets waiting for the writer thread
+    static const size_t maxQueueSize = 400;
+
     struct PacketData {
-        MsgPacket* p;
+        std::shared_ptr<MsgPacket> p;
         StreamInfo::Content content;
         int64_t pts;
+        std::chrono::steady_clock::time_point queueTime;
     };
 
+    struct Statistics {
+        uint64_t packetCount = 0;
+        uint64_t wakeupCount = 0;
+        uint64_t writeCount = 0;
+        std::chrono::microseconds latencySum{0};
+        std::chrono::microseconds latencyMax{0};
+        uint64_t overflowCount = 0;
+        uint64_t droppedNonReference = 0;
+        uint64_t droppedReference = 0;
+        uint64_t droppedOther = 0;
+        uint64_t droppedAudio = 0;
+        uint64_t lockCount = 0;
+        std::chrono::microseconds lockHoldSum{0};
+        std::chrono::microseconds lockHoldMax{0};
+    };
+
+    Statistics getStatistics();
+
+    /**
+     * Get the measured bitrate of the stream.
+     * @return bitrate in bytes/s (0 = not measured yet)
+     */
+    uint64_t getBitRate() const {
+        return m_bitRate;
+    }
+
 protected:
 
-    struct PacketIndex {
+    LiveQueue(const std::string& id);
+
+    virtual ~LiveQueue();
+
+    struct LiveRecord {
         off_t filePosition;
-        std::chrono::milliseconds wallclockTime;
-        int64_t pts;
         int wrapCount;
+        std::shared_ptr<MsgPacket> p;
     };
 
-    bool write(const PacketData& data);
+    void write(std::deque<PacketData>& batch);
 
     void start();
 
@@ -86,19 +285,159 @@ protected:
 
     void trim(off_t position);
 
-    MsgPacket* internalRead();
-
-    void seekNextKeyFrame();
-
-    std::deque<struct PacketIndex> m_indexList;
+    bool internalRead(Reader* reader, PacketView* view);
+
+    bool readRecord(Reader* reader, PacketView* view, uint32_t& length);
+
+    bool readLiveRecord(Reader* reader, PacketView* view, uint32_t& length);
+
+    void releaseLiveRecord(const LiveRecord& r);
+
+    void clearLiveCache();
+
+    uint8_t* fetchRecordData(Reader* reader, off_t position, uint32_t length);
+
+    /**
+     * Prepare a run of records for writing (m_mutex must be locked).
+     * Readers overrun by the run are moved ahead and the keyframe index is
+     * updated. The records are queued in the write vector, but not published
+     * to the readers. A run ends at a wrap of the ringbuffer.
+     * @param batch packets to write
+     * @param i first packet of the run
+     * @param timeStamp wallclock time of the batch
+     * @param runEnd receives the end position of the run
+     * @return first packet not in the run
+     */
+    std::deque<PacketData>::iterator stageRecords(std::deque<PacketData>& batch, std::deque<PacketData>::iterator i, std::chrono::milliseconds timeStamp, off_t& runEnd);
+
+    /**
+     * Write the records of the write vector (without holding m_mutex).
+     * @param position storage position of the run
+     * @return true on success
+     */
+    bool writeRecords(off_t position);
+
+    /**
+     * Drop the records of a run that couldn't be written (m_mutex must be locked).
+     * @param runStart storage position of the run
+     */
+    void rollbackRecords(off_t runStart);
+
+    /**
+     * Check for pages consumed by a reader (m_mutex must be locked).
+     * The pages are dropped by releasePages().
+     */
+    void releaseStorage(Reader* reader);
+
+    /**
+     * Drop the pages consumed by a reader from the page cache.
+     * @param reader read cursor of the client
+     * @param lock lock of m_mutex (released before dropping the pages)
+     */
+    void releasePages(Reader* reader, std::unique_lock<std::mutex>& lock);
+
+    /**
+     * Allocate storage segments.
+     * Allocates all segments of the ringbuffer file up to the given position.
+     * @param end end position of the data to be written
+     * @return true on success
+     */
+    bool allocateStorage(off_t end);
+
+    /**
+     * Release storage segments (m_mutex must be locked).
+     * Marks all segments behind the given position as unused. The hole is
+     * punched into the ringbuffer file by punchSegments().
+     * @param position end of the data still in use
+     */
+    void releaseSegments(off_t position);
+
+    /**
+     * Punch a hole for the released segments (writer thread, m_mutex unlocked).
+     */
+    void punchSegments();
+
+    /**
+     * Get the storage the ringbuffer file will still allocate.
+     * @return bytes not allocated yet
+     */
+    off_t getPendingStorage();
+
+    void resetReadPosition(Reader* reader, off_t position);
+
+    void setReadPosition(Reader* reader, const KeyFrameIndex::Entry& index);
+
+    void skipOverrun(Reader* reader, off_t position);
+
+    void seekNextKeyFrame(Reader* reader);
+
+    /**
+     * Read the keyframe due for a client in trick play mode.
+     * @param reader read cursor of the client
+     * @param view receives the packet
+     * @return true if a packet was read
+     */
+    bool readTrickPlay(Reader* reader, PacketView* view);
+
+    /**
+     * Get the index entry of the keyframe at or before the read position.
+     * @param reader read cursor of the client
+     * @return index of the keyframe (m_indexList must not be empty)
+     */
+    size_t currentKeyFrame(Reader* reader);
+
+    /**
+     * Check if a client has data to read (m_mutex must be locked).
+     * @param reader read cursor of the client
+     * @return true if a read makes progress
+     */
+    bool isReadable(Reader* reader);
+
+    // signalled when data for the readers has been published
+    std::condition_variable m_readCondition;
+
+    KeyFrameIndex m_indexList;
 
     int m_readFd;
 
     int m_writeFd;
 
-    int m_socket;
+    // end of the data published to the readers
+    off_t m_writePosition;
+
+    off_t m_wrapPosition;
 
-    bool m_pause;
+    off_t m_storageLength;
+
+    // read by other queues selecting a timeshift directory
+    std::atomic<off_t> m_allocatedLength{0};
+
+    // released segments waiting for punchSegments() (writer thread)
+    off_t m_punchStart = 0;
+
+    off_t m_punchEnd = 0;
+
+    static const off_t segmentSize = 32 * 1024 * 1024;
+
+    uint8_t* m_map = nullptr;
+
+    std::vector<struct iovec> m_writeVector;
+
+    std::vector<TimeShiftRecord::Header> m_recordHeaders;
+
+    std::deque<LiveRecord> m_liveCache;
+
+    uint64_t m_liveCacheLength;
+
+    static const off_t readBufferSize = 256 * 1024;
+
+    std::string m_id;
+
+    int m_storageId;
+
+    std::list<Reader*> m_readers;
+
+    std::shared_ptr<MsgPacket> m_streamInfo;
 
     std::mutex m_mutex;
 
@@ -106,28 +445,185 @@ protected:
 
     std::chrono::milliseconds m_queueStartTime;
 
-    bool m_wrapped;
-
     bool m_hasWrapped;
 
     int m_wrapCount;
 
-    static cString m_timeShiftDir;
+    static std::vector<std::string> m_timeShiftDirs;
+
+    /**
+     * Select the timeshift directory of a new queue.
+     * Picks the directory with the lowest write bandwidth that has enough
+     * free space (m_mutexQueues must be locked). Storage the sparse files of
+     * running queues will still allocate doesn't count as free.
+     * @return timeshift directory
+     */
+    static std::string selectTimeShiftDir();
+
+    std::string m_storageDir;
+
+    // assumed bitrate of streams without measurement (bytes/s)
+    static const uint64_t defaultBitRate = 1024 * 1024;
 
     static uint64_t m_bufferSize;
 
+    static uint64_t m_totalBufferSize;
+
+    static int m_maxBufferTime;
+
+    static StorageMode m_storageMode;
+
+    static uint64_t m_liveCacheSize;
+
+    static std::map<std::string, LiveQueue*> m_queues;
+
+    static std::mutex m_mutexQueues;
+
+    static int m_nextStorageId;
+
+    struct PoolFile {
+        std::string dir;
+        std::string path;
+    };
+
+    /**
+     * Take a spare timeshift file of the given directory from the pool.
+     * @param dir timeshift directory
+     * @param path path of the pooled file
+     * @return true if a file was available
+     */
+    static bool takePoolFile(const std::string& dir, std::string& path);
+
+    /**
+     * Return a timeshift file to the pool.
+     * @param dir timeshift directory
+     * @param path path of the file
+     * @return true if the file was taken, false if the pool is full
+     */
+    static bool returnPoolFile(const std::string& dir, const std::string& path);
+
+    // spare timeshift files (first segment allocated)
+    static std::list<PoolFile> m_filePool;
+
+    static int m_filePoolSize;
+
+    // pool lock, taken while a queue lock is held
+    static std::mutex m_mutexPool;
+
+    // creates the pool files in the background
+    static std::thread* m_poolThread;
+
+    static std::atomic<bool> m_poolRunning;
+
+    /**
+     * Create the missing spare files of every timeshift directory (pool thread).
+     */
+    static void fillFilePool();
+
 private:
 
     std::thread* m_writeThread;
 
     std::atomic<bool> m_writerRunning;
 
-    std::chrono::milliseconds m_lastSyncTime;
+    struct WritebackRange {
+        off_t position;
+        off_t length;
+        bool consumed;
+    };
+
+    off_t m_syncPosition;
+
+    std::vector<WritebackRange> m_writebackRanges;
+
+    WritebackRange m_lastWriteback = {0, 0, false};
+
+    static const off_t writebackWindow = 8 * 1024 * 1024;
 
     std::deque<PacketData> m_writerQueue;
 
+    Reader* m_writer = nullptr;
+
+    bool m_resync = false;
+
+    bool m_hasVideo = false;
+
+    int64_t m_lastVideoPts = 0;
+
+    int64_t m_lastAudioPts = 0;
+
+    bool m_dropUntilKeyFrame = false;
+
     std::mutex m_mutexQueue;
 
+    std::condition_variable m_writerCondition;
+
+    Statistics m_statistics;
+
+    std::mutex m_mutexStatistics;
+
+    void writerLoop();
+
+    void addWriteback(off_t position, off_t length);
+
+    void writeback();
+
+    bool updateBitRate();
+
+    /**
+     * Split the timeshift budget.
+     * Computes the buffer size of all queues (m_mutexQueues must be locked).
+     */
+    static void rebalance();
+
+    std::atomic<uint64_t> m_bufferLimit;
+
+    std::atomic<uint64_t> m_bitRate;
+
+    uint64_t m_bitRateBytes;
+
+    std::chrono::steady_clock::time_point m_bitRateStart;
+
+    void updateStatistics(const std::deque<PacketData>& batch);
+
+    bool acceptPacket(MsgPacket* p, StreamInfo::Content content, int64_t pts);
+
+    /**
+     * Put a packet into the writer queue.
+     * The queue doesn't exceed maxQueueSize packets (except for stream
+     * information, which is never dropped). If it is full, a single packet
+     * is dropped by priority: non-reference frames first, then subtitles /
+     * teletext, then reference frames (video is skipped up to the next
+     * keyframe). Incoming keyframes and audio are only dropped if nothing
+     * else is queued.
+     * @param data packet to queue
+     * @return false if the packet has been dropped
+     */
+    bool enqueue(const PacketData& data);
+
+    bool dropNonReferenceFrame();
+
+    bool dropOtherPacket();
+
+    /**
+     * Drop the newest queued reference frame (except keyframes).
+     */
+    bool dropReferenceFrame();
+
+    /**
+     * Count a dropped packet.
+     * @return new value of the counter
+     */
+    uint64_t countDrop(uint64_t Statistics::* counter);
+
+    /**
+     * Count the time the writer held the queue lock (m_mutex must be locked).
+     * @param locked time the lock was taken
+     */
+    void countLockTime(std::chrono::steady_clock::time_point locked);
+
+    void logStatistics();
+
 };
 
 #endif // ROBOTV_LIVEQUEUE_H
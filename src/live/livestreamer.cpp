@@ -41,39 +41,25 @@
 
 #include "livestreamer.h"
 #include "livequeue.h"
-#include "channelcache.h"
+#include "pretuner.h"
 
 #include <chrono>
-#include <robotv/StreamPacketProcessor.h>
-
-#define MIN_PACKET_SIZE (128 * 1024)
 
 using namespace std::chrono;
 
 LiveStreamer::LiveStreamer(RoboTvClient* parent, int priority)
-    : cReceiver(nullptr, priority)
-    , m_parent(parent)
-    , m_uid(0) {
-    // create send queue
-    m_queue = new LiveQueue(m_parent->getSocket());
+    : m_parent(parent)
+    , m_uid(0)
+    , m_priority(priority)
+    , m_pushRunning(false) {
 }
 
 LiveStreamer::~LiveStreamer() {
-    cDevice * device = Device();
-
-    if(device != nullptr) {
-        cCamSlot *camSlot = device->CamSlot();
-
-        if (camSlot != nullptr) {
-            isyslog("camslot detached");
-            ChannelCamRelations.ClrChecked(ChannelID(), camSlot->SlotNumber());
-        }
+    stopPushing();
 
-        Detach();
-    }
-
-    reset();
-    delete m_queue;
+    // the demuxer must not write into the queue anymore
+    LiveDemuxer::unsubscribe(m_demuxer, m_reader);
+    LiveQueue::detach(m_queue, m_reader);
     delete m_streamPacket;
 
     isyslog("live streamer terminated");
@@ -85,102 +71,45 @@ int LiveStreamer::switchChannel(const cChannel* channel) {
         return ROBOTV_RET_ERROR;
     }
 
-    // get device for this channel
-    cDevice* device = cDevice::GetDevice(channel, LIVEPRIORITY, false);
-
-    // maybe an encrypted channel that cannot be handled
-    // lets try if a device can decrypt it on it's own (without a CAM slot)
-    if(device == nullptr) {
-        device = cDevice::GetDeviceForTransponder(channel, LIVEPRIORITY);
-    }
-
-    // maybe all devices busy
-    if(device == nullptr) {
-        esyslog("No device available !");
-        return ROBOTV_RET_DATALOCKED;
-    }
-
-    isyslog("Found available device %d", device->DeviceNumber() + 1);
-
-    if(!device->SwitchChannel(channel, false)) {
-        esyslog("Can't switch to channel %i - %s", channel->Number(), channel->Name());
-        return ROBOTV_RET_ERROR;
-    }
-
     m_uid = createChannelUid(channel);
 
-    StreamBundle currentItem = createFromChannel(channel);
-
-    // get cached demuxer data
-    ChannelCache &cache = ChannelCache::instance();
-    StreamBundle cacheItem = cache.lookup(m_uid);
-
-    // channel already in cache
-    if (!cacheItem.empty()) {
-        isyslog("Channel information found in cache");
-    }
-    // channel not found in cache -> add it from vdr
-    else {
-        isyslog("adding channel to cache");
-        cacheItem = currentItem;
-        cache.add(m_uid, cacheItem);
-    }
-
-    // recheck cache item
-    if (!currentItem.isMetaOf(cacheItem)) {
-        isyslog("current channel differs from cache item - updating");
-        cacheItem = currentItem;
-        cache.add(m_uid, cacheItem);
-    }
-
-    if(cacheItem.empty()) {
-        esyslog("channel %i - %s doesn't have any stream information", channel->Number(), channel->Name());
-        return false;
-    }
-
-    isyslog("Creating demuxers");
-    createDemuxers(&cacheItem);
-
-    onStreamChange();
-
-    isyslog("Successfully switched to channel %i - %s", channel->Number(), channel->Name());
+    int status = subscribe(channel, m_pids, m_queue, m_reader, m_demuxer);
 
-    // fool device to not start the decryption timer
-    int priority = Priority();
-    SetPriority(MINPRIORITY);
-
-    /// attach receiver
-    if (device->AttachReceiver(this) == false) {
-        esyslog("failed to attach receiver !");
-        return false;
-    }
-
-    // start decrypting manually
-    cCamSlot* slot = device->CamSlot();
-
-    if(slot) {
-        slot->StartDecrypting();
+    if(status != ROBOTV_RET_OK) {
+        return status;
     }
 
-    SetPriority(priority);
+    PreTuner::instance().channelStarted(m_uid);
 
     isyslog("done switching.");
     return ROBOTV_RET_OK;
 }
 
-MsgPacket *LiveStreamer::createStreamChangePacket(DemuxerBundle &bundle) {
-    StreamBundle cache;
-
-    for(auto i = bundle.begin(); i != bundle.end(); i++) {
-        cache.addStream(*(*i));
+int LiveStreamer::subscribe(const cChannel* channel, const std::set<int>& pids, LiveQueue*& queue, LiveQueue::Reader*& reader, LiveDemuxer*& demuxer) {
+    // the client would get no streams at all
+    if(!LiveDemuxer::hasStreams(channel, pids)) {
+        esyslog("none of the selected streams belongs to channel %i - %s", channel->Number(), channel->Name());
+        return ROBOTV_RET_DATAINVALID;
     }
 
-    ChannelCache::instance().add(m_uid, cache);
+    // attach to the timeshift queue of the channel
+    // (shared with all clients using the same stream order and selection)
+    if(queue == nullptr) {
+        std::string id = (const char*)cString::sprintf("%08x-%s-%i", createChannelUid(channel), m_language.c_str(), (int)m_langStreamType);
 
-    // reorder streams as preferred
-    bundle.reorderStreams(m_language.c_str(), m_langStreamType);
+        for(int pid : pids) {
+            id += (const char*)cString::sprintf("-%i", pid);
+        }
 
-    return StreamPacketProcessor::createStreamChangePacket(bundle);
+        queue = LiveQueue::attach(id, m_parent->getSocket(), reader);
+    }
+
+    // subscribe to the demuxer of the channel
+    // (shared with all clients watching the channel)
+    int status = ROBOTV_RET_OK;
+    demuxer = LiveDemuxer::subscribe(channel, m_priority, queue, reader, m_language, m_langStreamType, pids, status);
+
+    return (demuxer == nullptr) ? status : ROBOTV_RET_OK;
 }
 
 void LiveStreamer::sendStatus(int status) {
@@ -190,9 +119,13 @@ void LiveStreamer::sendStatus(int status) {
 }
 
 void LiveStreamer::requestSignalInfo() {
-    cDevice* device = Device();
+    if(m_demuxer == nullptr || !m_demuxer->IsAttached()) {
+        return;
+    }
 
-    if(device == nullptr || !IsAttached()) {
+    cDevice* device = m_demuxer->getDevice();
+
+    if(device == nullptr) {
         return;
     }
 
@@ -260,7 +193,7 @@ void LiveStreamer::requestSignalInfo() {
     }
 
     dsyslog("RequestSignalInfo");
-    m_queue->queue(resp, StreamInfo::Content::NONE);
+    m_queue->send(m_reader, resp);
 }
 
 void LiveStreamer::setLanguage(const char* lang, StreamInfo::Type streamtype) {
@@ -272,12 +205,71 @@ void LiveStreamer::setLanguage(const char* lang, StreamInfo::Type streamtype) {
     m_langStreamType = streamtype;
 }
 
+void LiveStreamer::setStreams(const std::set<int>& pids) {
+    m_pids = pids;
+}
+
+int LiveStreamer::selectStreams(const cChannel* channel, const std::set<int>& pids) {
+    if(pids == m_pids) {
+        return ROBOTV_RET_OK;
+    }
+
+    if(channel == nullptr) {
+        esyslog("unknown channel !");
+        return ROBOTV_RET_ERROR;
+    }
+
+    std::lock_guard<std::mutex> lockSelect(m_selectMutex);
+
+    isyslog("selecting %lu streams", pids.size());
+
+    // subscribe with the new selection before leaving the old one
+    // (the channel stays received, the current stream continues on failure)
+    LiveQueue* queue = nullptr;
+    LiveQueue::Reader* reader = nullptr;
+    LiveDemuxer* demuxer = nullptr;
+
+    int status = subscribe(channel, pids, queue, reader, demuxer);
+
+    if(status != ROBOTV_RET_OK) {
+        esyslog("failed to select streams - keeping current selection");
+        LiveQueue::detach(queue, reader);
+        return status;
+    }
+
+    bool push = isPushing();
+    stopPushing();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // remove pending packet
+        delete m_streamPacket;
+        m_streamPacket = nullptr;
+
+        std::swap(m_queue, queue);
+        std::swap(m_reader, reader);
+        std::swap(m_demuxer, demuxer);
+        m_pids = pids;
+    }
+
+    // leave the previous selection
+    LiveDemuxer::unsubscribe(demuxer, reader);
+    LiveQueue::detach(queue, reader);
+
+    if(push) {
+        startPushing();
+    }
+
+    return ROBOTV_RET_OK;
+}
+
 bool LiveStreamer::isPaused() {
     if(m_queue == nullptr) {
         return false;
     }
 
-    return m_queue->isPaused();
+    return m_queue->isPaused(m_reader);
 }
 
 void LiveStreamer::pause(bool on) {
@@ -285,45 +277,62 @@ void LiveStreamer::pause(bool on) {
         return;
     }
 
-    m_queue->pause(on);
+    m_queue->pause(m_reader, on);
 }
 
 MsgPacket* LiveStreamer::requestPacket() {
     std::lock_guard<std::mutex> lock(m_mutex);
 
+    if(m_queue == nullptr) {
+        return nullptr;
+    }
+
     // create payload packet
     if(m_streamPacket == nullptr) {
         m_streamPacket = new MsgPacket();
         m_streamPacket->put_S64(m_queue->getTimeshiftStartPosition());
         m_streamPacket->put_S64(roboTV::currentTimeMillis().count());
         m_streamPacket->disablePayloadCheckSum();
+
+        m_aggregator.reset();
+        m_aggregator.setBitRate(m_queue->getBitRate());
     }
 
     // request packet from queue
-    MsgPacket* p = nullptr;
-
-    while((p = m_queue->read()) != nullptr) {
+    auto consumer = [&](const LiveQueue::PacketView& p) {
+        m_aggregator.add(p.length + 4);
 
         // add data
-        m_streamPacket->put_U16(p->getMsgID());
-        m_streamPacket->put_U16(p->getClientID());
+        m_streamPacket->put_U16(p.msgId);
+        m_streamPacket->put_U16(p.clientId);
 
         // add payload
-        uint8_t* data = p->getPayload();
-        int length = p->getPayloadLength();
-        m_streamPacket->put_Blob(data, length);
+        // (reference packets of the live cache instead of copying them)
+        if(p.packet) {
+            m_streamPacket->put_Ref(p.packet);
+        }
+        else {
+            m_streamPacket->put_Blob(p.payload, p.length);
+        }
+    };
 
-        delete p;
+    while(m_queue->read(m_reader, consumer)) {
 
         // send payload packet if it's big enough
-        if(m_streamPacket->getPayloadLength() >= MIN_PACKET_SIZE) {
+        // (keyframes in trick play mode are sent one by one)
+        if(m_aggregator.ready() || m_queue->getTrickPlayRate(m_reader) != 0) {
             MsgPacket* result = m_streamPacket;
             m_streamPacket = nullptr;
             return result;
         }
     }
 
-    if(m_queue->isPaused()) {
+    // send pending data when the latency deadline is reached
+    // (paused clients get an empty packet in pull mode)
+    bool paused = m_queue->isPaused(m_reader);
+    bool flush = m_aggregator.ready() || (paused && (!m_push || !m_aggregator.empty()));
+
+    if(flush) {
         MsgPacket* result = m_streamPacket;
         m_streamPacket = nullptr;
         return result;
@@ -332,34 +341,75 @@ MsgPacket* LiveStreamer::requestPacket() {
     return nullptr;
 }
 
-void LiveStreamer::Receive(const uchar* packet, int length) {
-    putTsPacket((uint8_t*)packet, roboTV::currentTimeMillis().count());
+void LiveStreamer::startPushing() {
+    if(m_queue == nullptr || m_pushThread != nullptr) {
+        return;
+    }
+
+    isyslog("live streamer: push mode");
+
+    m_push = true;
+    m_pushRunning = true;
+    m_pushThread = new std::thread(&LiveStreamer::pushLoop, this);
 }
 
-void LiveStreamer::processChannelChange(const cChannel* channel) {
-    if(createChannelUid(channel) != m_uid) {
+void LiveStreamer::setLatency(milliseconds latency) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_aggregator.setLatency(latency);
+}
+
+void LiveStreamer::stopPushing() {
+    if(m_pushThread == nullptr) {
         return;
     }
 
-    isyslog("ChannelChange()");
+    m_pushRunning = false;
+    m_pushThread->join();
 
-    Detach();
-    flush();
-    switchChannel(channel);
+    delete m_pushThread;
+    m_pushThread = nullptr;
 }
 
-void LiveStreamer::createDemuxers(StreamBundle* bundle) {
-    DemuxerBundle& demuxers = getDemuxers();
+void LiveStreamer::pushLoop() {
+    while(m_pushRunning) {
+        MsgPacket* p = requestPacket();
+
+        if(p != nullptr) {
+            p->setType(ROBOTV_CHANNEL_STREAM);
+            p->setMsgID(ROBOTV_STREAM_PACKET);
+            m_parent->sendMessage(p);
+            continue;
+        }
 
-    // update demuxers
-    demuxers.updateFrom(bundle);
+        // wait for new data
+        // (at most until the deadline of pending data, trick play needs regular reads)
+        milliseconds timeout(100);
 
-    // update pids
-    SetPids(nullptr);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
 
-    for(auto i = demuxers.begin(); i != demuxers.end(); i++) {
-        TsDemuxer* dmx = *i;
-        AddPid(dmx->getPid());
+            if(m_streamPacket != nullptr && !m_aggregator.empty()) {
+                timeout = std::max(milliseconds(1), m_aggregator.timeLeft());
+            }
+        }
+
+        if(m_queue->getTrickPlayRate(m_reader) != 0) {
+            timeout = std::min(timeout, milliseconds(20));
+        }
+
+        m_queue->waitForData(m_reader, timeout);
+    }
+}
+
+void LiveStreamer::processChannelChange(const cChannel* channel) {
+    if(createChannelUid(channel) != m_uid) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_selectMutex);
+
+    if(m_demuxer != nullptr) {
+        m_demuxer->processChannelChange(channel);
     }
 }
 
@@ -370,64 +420,24 @@ int64_t LiveStreamer::seek(int64_t wallclockPositionMs) {
     delete m_streamPacket;
     m_streamPacket = nullptr;
 
-    // seek
-    return m_queue->seek(wallclockPositionMs);
-}
-
-StreamBundle LiveStreamer::createFromChannel(const cChannel* channel) {
-    StreamBundle item;
-
-    // add video stream
-    int vpid = channel->Vpid();
-    int vtype = channel->Vtype();
-
-    item.addStream(StreamInfo(vpid,
-                              vtype == 0x02 ? StreamInfo::Type::MPEG2VIDEO :
-                              vtype == 0x1b ? StreamInfo::Type::H264 :
-                              vtype == 0x24 ? StreamInfo::Type::H265 :
-                              StreamInfo::Type::NONE));
-
-    // add (E)AC3 streams
-    for(int i = 0; channel->Dpid(i) != 0; i++) {
-        int dtype = channel->Dtype(i);
-        item.addStream(StreamInfo(channel->Dpid(i),
-                                  dtype == 0x6A ? StreamInfo::Type::AC3 :
-                                  dtype == 0x7A ? StreamInfo::Type::EAC3 :
-                                  StreamInfo::Type::NONE,
-                                  channel->Dlang(i)));
+    if(m_queue == nullptr) {
+        return 0;
     }
 
-    // add audio streams
-    for(int i = 0; channel->Apid(i) != 0; i++) {
-        int atype = channel->Atype(i);
-        item.addStream(StreamInfo(channel->Apid(i),
-                                  atype == 0x04 ? StreamInfo::Type::MPEG2AUDIO :
-                                  atype == 0x03 ? StreamInfo::Type::MPEG2AUDIO :
-                                  atype == 0x0f ? StreamInfo::Type::AAC :
-                                  atype == 0x11 ? StreamInfo::Type::LATM :
-                                  StreamInfo::Type::NONE,
-                                  channel->Alang(i)));
-    }
+    // seek
+    return m_queue->seek(m_reader, wallclockPositionMs);
+}
 
-    // add subtitle streams
-    for(int i = 0; channel->Spid(i) != 0; i++) {
-        StreamInfo stream(channel->Spid(i), StreamInfo::Type::DVBSUB, channel->Slang(i));
+int64_t LiveStreamer::trickPlay(int rate) {
+    std::lock_guard<std::mutex> lock(m_mutex);
 
-        stream.setSubtitlingDescriptor(
-                channel->SubtitlingType(i),
-                channel->CompositionPageId(i),
-                channel->AncillaryPageId(i));
+    // remove pending packet
+    delete m_streamPacket;
+    m_streamPacket = nullptr;
 
-        item.addStream(stream);
+    if(m_queue == nullptr) {
+        return 0;
     }
 
-    return item;
-}
-
-int64_t LiveStreamer::getCurrentTime(TsDemuxer::StreamPacket *p) {
-    return p->streamPosition;
-}
-
-void LiveStreamer::onPacket(MsgPacket *p, StreamInfo::Content content, int64_t pts) {
-    m_queue->queue(p, content, pts);
+    return m_queue->trickPlay(m_reader, rate);
 }
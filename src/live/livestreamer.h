@@ -27,63 +27,78 @@
 
 #include <stdint.h>
 #include <vdr/channels.h>
-#include <vdr/device.h>
-#include <vdr/receiver.h>
-#include <vdr/ringbuffer.h>
 
-#include "robotvdmx/demuxer.h"
-#include "robotvdmx/streambundle.h"
-#include "robotvdmx/demuxerbundle.h"
 #include "robotv/robotvcommand.h"
 #include "livequeue.h"
+#include "livedemuxer.h"
+#include "robotv/StreamPacketAggregator.h"
 
-#include <list>
 #include <mutex>
-#include <robotv/StreamPacketProcessor.h>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <chrono>
 
 class cChannel;
 class MsgPacket;
 class LiveQueue;
 class RoboTvClient;
 
-class LiveStreamer : public cReceiver, protected StreamPacketProcessor {
+class LiveStreamer {
 private:
 
     void sendStatus(int status);
 
     LiveQueue* m_queue = NULL;
 
+    LiveQueue::Reader* m_reader = NULL;
+
+    LiveDemuxer* m_demuxer = nullptr;
+
     RoboTvClient* m_parent = NULL;
 
     std::string m_language;
 
     StreamInfo::Type m_langStreamType = StreamInfo::Type::AC3;
 
+    // selected streams (empty for all streams)
+    std::set<int> m_pids;
+
     uint32_t m_uid;
 
+    int m_priority;
+
     std::mutex m_mutex;
 
-    MsgPacket* m_streamPacket = NULL;
+    // serializes stream selections with channel changes
+    // (the previous demuxer is released by selectStreams())
+    std::mutex m_selectMutex;
 
-protected:
+    MsgPacket* m_streamPacket = NULL;
 
-#if VDRVERSNUM < 20300
-    void Receive(uchar* data, int length);
-#else
-    void Receive(const uchar* Data, int Length);
-#endif
+    StreamPacketAggregator m_aggregator;
 
-    int64_t getCurrentTime(TsDemuxer::StreamPacket *p);
+    bool m_push = false;
 
-    void onPacket(MsgPacket* p, StreamInfo::Content content, int64_t pts);
+    std::atomic<bool> m_pushRunning;
 
-    MsgPacket* createStreamChangePacket(DemuxerBundle& bundle);
+    std::thread* m_pushThread = nullptr;
 
-private:
+    void pushLoop();
 
-    StreamBundle createFromChannel(const cChannel* channel);
+    void stopPushing();
 
-    void createDemuxers(StreamBundle* bundle);
+    /**
+     * Attach to the timeshift queue of a stream selection and subscribe to
+     * the demuxer of the channel.
+     * @param channel channel to receive
+     * @param pids selected streams (empty for all streams)
+     * @param queue timeshift queue (attached if nullptr)
+     * @param reader reader of the queue
+     * @param demuxer subscribed demuxer (nullptr on failure)
+     * @return ROBOTV_RET_OK on success
+     */
+    int subscribe(const cChannel* channel, const std::set<int>& pids, LiveQueue*& queue, LiveQueue::Reader*& reader, LiveDemuxer*& demuxer);
 
 public:
 
@@ -97,16 +112,57 @@ public:
 
     void setLanguage(const char* lang, StreamInfo::Type streamtype = StreamInfo::Type::AC3);
 
+    /**
+     * Set the streams to receive (before switching the channel).
+     * Other streams of the channel are neither stored nor sent.
+     * @param pids pids of the selected streams (empty for all streams)
+     */
+    void setStreams(const std::set<int>& pids);
+
+    /**
+     * Change the selected streams of a running stream.
+     * The client continues on the timeshift queue of the new selection
+     * (starting with the stream information and the last keyframe).
+     * @param channel current channel
+     * @param pids pids of the selected streams (empty for all streams)
+     * @return ROBOTV_RET_OK on success, ROBOTV_RET_DATAINVALID if none of
+     * the streams belongs to the channel
+     */
+    int selectStreams(const cChannel* channel, const std::set<int>& pids);
+
     void pause(bool on);
 
     MsgPacket* requestPacket();
 
+    /**
+     * Push stream packets to the client.
+     * Aggregated packets (ROBOTV_STREAM_PACKET) are sent as soon as enough
+     * data is available or the latency deadline is reached.
+     */
+    void startPushing();
+
+    /**
+     * Set the target latency of stream packets.
+     * @param latency latency requested by the client (0 = default)
+     */
+    void setLatency(std::chrono::milliseconds latency);
+
+    bool isPushing() const {
+        return m_push;
+    }
+
     void requestSignalInfo();
 
     int switchChannel(const cChannel* channel);
 
+    uint32_t getChannelUid() const {
+        return m_uid;
+    }
+
     int64_t seek(int64_t wallclockPositionMs);
 
+    int64_t trickPlay(int rate);
+
 };
 
 #endif  // ROBOTV_RECEIVER_H
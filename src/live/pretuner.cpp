@@ -0,0 +1,207 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <algorithm>
+
+#include "tools/hash.h"
+#include "pretuner.h"
+#include "livedemuxer.h"
+
+using namespace std::chrono;
+
+PreTuner& PreTuner::instance() {
+    static PreTuner preTuner;
+    return preTuner;
+}
+
+void PreTuner::setChannelCount(int count) {
+    m_channelCount = std::max(count, 0);
+    isyslog("pre-tuning of %i channels %s", m_channelCount, m_channelCount > 0 ? "enabled" : "disabled");
+}
+
+void PreTuner::start() {
+    if(m_channelCount == 0 || m_thread != nullptr) {
+        return;
+    }
+
+    // keep channels after the last client left (recent history)
+    LiveDemuxer::setKeepReceiving(true);
+
+    m_running = true;
+    m_thread = new std::thread(&PreTuner::run, this);
+}
+
+void PreTuner::stop() {
+    if(m_thread == nullptr) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+
+    m_condition.notify_one();
+    m_thread->join();
+
+    delete m_thread;
+    m_thread = nullptr;
+
+    LiveDemuxer::setKeepReceiving(false);
+
+    for(uint32_t uid : LiveDemuxer::getPreTunedChannels()) {
+        LiveDemuxer::releasePreTune(uid);
+    }
+}
+
+void PreTuner::channelStarted(uint32_t uid) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_history.erase(std::remove(m_history.begin(), m_history.end(), uid), m_history.end());
+        m_history.push_front(uid);
+
+        if(m_history.size() > maxHistory) {
+            m_history.pop_back();
+        }
+
+        m_updateRequested = true;
+    }
+
+    m_condition.notify_one();
+}
+
+void PreTuner::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while(m_running) {
+        // check regularly for receivers detached by VDR
+        m_condition.wait_for(lock, seconds(2), [&]() {
+            return !m_running || m_updateRequested;
+        });
+
+        if(!m_running) {
+            break;
+        }
+
+        m_updateRequested = false;
+
+        lock.unlock();
+        update();
+        lock.lock();
+    }
+}
+
+void PreTuner::update() {
+    std::vector<uint32_t> active = LiveDemuxer::getSubscribedChannels();
+    std::vector<uint32_t> wanted;
+
+    // tuning takes a while, don't block VDR's channel list meanwhile
+    // (work on copies of the channels)
+    std::vector<cChannel> channels;
+
+    {
+        LOCK_CHANNELS_READ;
+
+        for(auto channel : selectChannels(Channels, active)) {
+            wanted.push_back(createChannelUid(channel));
+            channels.push_back(*channel);
+        }
+    }
+
+    // release channels not needed anymore (or taken over by VDR)
+    for(uint32_t uid : LiveDemuxer::getPreTunedChannels()) {
+        if(std::find(wanted.begin(), wanted.end(), uid) == wanted.end() || !LiveDemuxer::isReceiving(uid)) {
+            LiveDemuxer::releasePreTune(uid);
+        }
+    }
+
+    // pre-tune the remaining channels on idle devices
+    for(const auto& channel : channels) {
+        if(!LiveDemuxer::isReceiving(createChannelUid(&channel))) {
+            LiveDemuxer::preTune(&channel);
+        }
+    }
+}
+
+std::vector<const cChannel*> PreTuner::selectChannels(const cChannels* channels, const std::vector<uint32_t>& active) {
+    std::vector<const cChannel*> candidates;
+    std::vector<const cChannel*> result;
+
+    // no clients -> leave all devices alone
+    if(active.empty()) {
+        return result;
+    }
+
+    // neighbours of the watched channels
+    for(uint32_t uid : active) {
+        const cChannel* channel = findChannelByUid(channels, uid);
+
+        if(channel == nullptr) {
+            continue;
+        }
+
+        candidates.push_back(channels->GetByNumber(channel->Number() + 1, 1));
+        candidates.push_back(channels->GetByNumber(channel->Number() - 1, -1));
+    }
+
+    // recently watched channels
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for(uint32_t uid : m_history) {
+            candidates.push_back(findChannelByUid(channels, uid));
+        }
+    }
+
+    for(auto channel : candidates) {
+        if((int)result.size() >= m_channelCount) {
+            break;
+        }
+
+        if(channel == nullptr || channel->GroupSep()) {
+            continue;
+        }
+
+        // encrypted channels would occupy CAM slots
+        if(channel->Ca(0) >= CA_ENCRYPTED_MIN) {
+            continue;
+        }
+
+        uint32_t uid = createChannelUid(channel);
+
+        if(std::find(active.begin(), active.end(), uid) != active.end()) {
+            continue;
+        }
+
+        if(std::find(result.begin(), result.end(), channel) != result.end()) {
+            continue;
+        }
+
+        result.push_back(channel);
+    }
+
+    return result;
+}
@@ -0,0 +1,101 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_PRETUNER_H
+#define ROBOTV_PRETUNER_H
+
+#include <stdint.h>
+#include <vdr/channels.h>
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+/**
+ * Background pre-tuning of channels a client is likely to zap to.
+ * The neighbours (by channel number) of all watched channels and the most
+ * recently watched channels are received on idle devices, so their
+ * demuxers and GOP caches are ready when a client opens them. Pre-tuned
+ * receivers have the lowest priority and are given up whenever VDR needs
+ * the device.
+ */
+class PreTuner {
+public:
+
+    static PreTuner& instance();
+
+    /**
+     * Set the maximum number of pre-tuned channels.
+     * @param count number of channels (0 disables pre-tuning)
+     */
+    void setChannelCount(int count);
+
+    void start();
+
+    void stop();
+
+    /**
+     * Notify the pre-tuner that a client started watching a channel.
+     * @param uid channel uid
+     */
+    void channelStarted(uint32_t uid);
+
+protected:
+
+    PreTuner() = default;
+
+private:
+
+    void run();
+
+    void update();
+
+    /**
+     * Get the channels to pre-tune (most likely first).
+     * @param active channels watched by clients
+     */
+    std::vector<const cChannel*> selectChannels(const cChannels* channels, const std::vector<uint32_t>& active);
+
+    static const size_t maxHistory = 8;
+
+    int m_channelCount = 0;
+
+    // recently watched channels (most recent first)
+    std::deque<uint32_t> m_history;
+
+    std::thread* m_thread = nullptr;
+
+    bool m_running = false;
+
+    bool m_updateRequested = false;
+
+    std::mutex m_mutex;
+
+    std::condition_variable m_condition;
+};
+
+#endif // ROBOTV_PRETUNER_H
@@ -0,0 +1,41 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <string.h>
+
+#include "net/msgpacket.h"
+#include "timeshiftrecord.h"
+
+static_assert(sizeof(TimeShiftRecord::Header) == TimeShiftRecord::HeaderLength, "unexpected record header size");
+
+void TimeShiftRecord::encode(MsgPacket* p, Header& header) {
+    header.length = p->getPayloadLength();
+    header.msgId = p->getMsgID();
+    header.clientId = p->getClientID();
+}
+
+void TimeShiftRecord::decode(const uint8_t* data, Header& header) {
+    memcpy(&header, data, HeaderLength);
+}
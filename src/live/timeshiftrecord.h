@@ -0,0 +1,83 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_TIMESHIFTRECORD_H
+#define ROBOTV_TIMESHIFTRECORD_H
+
+#include <stdint.h>
+
+class MsgPacket;
+
+// TIMESHIFT RECORD DEFINITION
+//
+// Packets are stored in the timeshift ringbuffer as records with a compact
+// header followed by the payload of the packet. The file is only ever read
+// by the queue that wrote it, so there is no sync mark, no checksum and the
+// header fields are stored in host byte order.
+
+// pos    type       description
+// 0      uint32_t   payload length
+// 4      uint16_t   message id
+// 6      uint16_t   client id (frame type of stream packets)
+
+class TimeShiftRecord {
+public:
+
+    enum {
+        HeaderLength = 8
+    };
+
+    struct Header {
+        uint32_t length;
+        uint16_t msgId;
+        uint16_t clientId;
+    };
+
+    /**
+     * Create the record header for a packet.
+     * @param p packet to store
+     * @param header header to fill
+     */
+    static void encode(MsgPacket* p, Header& header);
+
+    /**
+     * Decode a record header.
+     * @param data pointer to at least HeaderLength bytes of record data
+     * @param header decoded header
+     */
+    static void decode(const uint8_t* data, Header& header);
+
+    /**
+     * Get the total length of a record.
+     * @param header record header
+     * @return length of the record (header + payload) in bytes
+     */
+    static inline uint32_t recordLength(const Header& header) {
+        return HeaderLength + header.length;
+    }
+
+};
+
+#endif // ROBOTV_TIMESHIFTRECORD_H
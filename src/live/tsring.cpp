@@ -0,0 +1,89 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <string.h>
+#include "tsring.h"
+
+static size_t roundUpPowerOfTwo(size_t n) {
+    size_t size = 1;
+
+    while(size < n) {
+        size <<= 1;
+    }
+
+    return size;
+}
+
+TsRing::TsRing(size_t packetCount) : m_slots(roundUpPowerOfTwo(packetCount)), m_head(0), m_tail(0), m_maxSize(0), m_overflowCount(0) {
+    m_mask = m_slots.size() - 1;
+}
+
+bool TsRing::put(const uint8_t* data, int64_t timeStamp) {
+    size_t head = m_head.load(std::memory_order_relaxed);
+    size_t tail = m_tail.load(std::memory_order_acquire);
+    size_t count = head - tail;
+
+    if(count >= m_slots.size()) {
+        m_overflowCount.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Slot& slot = m_slots[head & m_mask];
+    slot.timeStamp = timeStamp;
+    memcpy(slot.data, data, packetSize);
+
+    m_head.store(head + 1, std::memory_order_release);
+
+    if(count + 1 > m_maxSize.load(std::memory_order_relaxed)) {
+        m_maxSize.store(count + 1, std::memory_order_relaxed);
+    }
+
+    return (count == 0);
+}
+
+uint8_t* TsRing::front(int64_t& timeStamp) {
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+
+    if(tail == m_head.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+
+    Slot& slot = m_slots[tail & m_mask];
+    timeStamp = slot.timeStamp;
+
+    return slot.data;
+}
+
+void TsRing::pop() {
+    m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void TsRing::clear() {
+    m_tail.store(m_head.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+size_t TsRing::size() const {
+    return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+}
@@ -0,0 +1,122 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_TSRING_H
+#define ROBOTV_TSRING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+#include <vector>
+
+/**
+ * Ring of raw TS packets between the receiver and the demuxer.
+ * Lock-free single-producer / single-consumer ring with a fixed number of
+ * TS packet slots. The producer never blocks: packets that don't fit are
+ * dropped and counted.
+ */
+class TsRing {
+public:
+
+    static const size_t packetSize = 188;
+
+    /**
+     * Create a ring.
+     * @param packetCount number of TS packets (rounded up to a power of two)
+     */
+    TsRing(size_t packetCount = defaultPacketCount);
+
+    /**
+     * Put a TS packet into the ring (producer).
+     * @param data TS packet
+     * @param timeStamp wallclock time of the packet in milliseconds
+     * @return true if the ring was empty before (the consumer may be waiting)
+     */
+    bool put(const uint8_t* data, int64_t timeStamp);
+
+    /**
+     * Get the oldest TS packet of the ring (consumer).
+     * The packet stays in the ring until pop() is called.
+     * @param timeStamp receives the wallclock time of the packet
+     * @return TS packet or nullptr if the ring is empty
+     */
+    uint8_t* front(int64_t& timeStamp);
+
+    /**
+     * Remove the oldest TS packet (consumer).
+     */
+    void pop();
+
+    /**
+     * Drop all packets (consumer).
+     */
+    void clear();
+
+    size_t size() const;
+
+    size_t capacity() const {
+        return m_slots.size();
+    }
+
+    /**
+     * Get the highest number of packets held at once.
+     */
+    size_t maxSize() const {
+        return m_maxSize;
+    }
+
+    /**
+     * Get the number of packets dropped because the ring was full.
+     */
+    uint64_t overflowCount() const {
+        return m_overflowCount;
+    }
+
+private:
+
+    struct Slot {
+        int64_t timeStamp;
+        uint8_t data[packetSize];
+    };
+
+    static const size_t defaultPacketCount = 16384;
+
+    std::vector<Slot> m_slots;
+
+    size_t m_mask;
+
+    // written by the producer only
+    std::atomic<size_t> m_head;
+
+    // written by the consumer only
+    std::atomic<size_t> m_tail;
+
+    std::atomic<size_t> m_maxSize;
+
+    std::atomic<uint64_t> m_overflowCount;
+};
+
+#endif // ROBOTV_TSRING_H
@@ -11,6 +11,12 @@
 #include <sys/types.h>
 #include <iostream>
 #include <unistd.h>
+#include <limits.h>
+#include <algorithm>
+
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
 
 #include "os-config.h"
 #include "msgpacket.h"
@@ -196,9 +202,21 @@ bool MsgPacket::put_Blob(uint8_t source[], uint32_t length) {
     return true;
 }
 
+bool MsgPacket::put_Ref(const std::shared_ptr<MsgPacket>& packet) {
+#ifdef WIN32
+    return put_Blob(packet->getPayload(), packet->getPayloadLength());
+#else
+    m_references.push_back({m_usage, packet});
+    m_referenceLength += packet->getPayloadLength();
+    return true;
+#endif
+}
+
 void MsgPacket::clear() {
     m_usage = HeaderLength;
     m_readposition = HeaderLength;
+    m_references.clear();
+    m_referenceLength = 0;
 }
 
 void MsgPacket::rewind() {
@@ -354,13 +372,23 @@ void MsgPacket::freeze() {
     }
 
     uint32_t payloadCheckSum = 0;
+    uint32_t payloadLength = m_usage - HeaderLength + m_referenceLength;
 
-    if(getPayloadLength() > 0 && m_payloadchecksum) {
-        payloadCheckSum = crc32(m_packet + HeaderLength, m_usage - HeaderLength);
+    if(payloadLength > 0 && m_payloadchecksum) {
+        uint32_t position = HeaderLength;
+
+        // payload in the order it is sent
+        for(const auto& r : m_references) {
+            payloadCheckSum = crc32(m_packet + position, r.position - position, payloadCheckSum);
+            payloadCheckSum = crc32(r.packet->getPayload(), r.packet->getPayloadLength(), payloadCheckSum);
+            position = r.position;
+        }
+
+        payloadCheckSum = crc32(m_packet + position, m_usage - position, payloadCheckSum);
     }
 
     writePacket<uint32_t>(PayloadCheckSumPos, htobe32(payloadCheckSum));
-    writePacket<uint32_t>(PayloadLengthPos, htobe32(m_usage - HeaderLength));
+    writePacket<uint32_t>(PayloadLengthPos, htobe32(payloadLength));
     writePacket<uint32_t>(CheckSumPos, htobe32(crc32(m_packet, CheckSumPos)));
 
     m_freezed = true;
@@ -397,9 +425,9 @@ bool MsgPacket::checkPacketSize(uint32_t bytes) {
     return true;
 }
 
-uint32_t MsgPacket::crc32(const uint8_t* buf, int size) {
-    uint32_t crc = 0xFFFFFFFF;
+uint32_t MsgPacket::crc32(const uint8_t* buf, int size, uint32_t crc) {
     const uint8_t* p = buf;
+    crc ^= ~0U;
 
     while(size--) {
         crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
@@ -411,6 +439,10 @@ uint32_t MsgPacket::crc32(const uint8_t* buf, int size) {
 bool MsgPacket::write(int fd, int timeout_ms) {
     freeze();
 
+    if(!m_references.empty()) {
+        return writeVector(fd, timeout_ms);
+    }
+
     uint32_t written = 0;
 
     while(written < m_usage) {
@@ -438,6 +470,74 @@ bool MsgPacket::write(int fd, int timeout_ms) {
     return true;
 }
 
+bool MsgPacket::writeVector(int fd, int timeout_ms) {
+#ifdef WIN32
+    return false;
+#else
+    std::vector<struct iovec> iov;
+    iov.reserve(m_references.size() * 2 + 1);
+
+    // own data interleaved with the referenced payloads
+    uint32_t position = 0;
+
+    for(const auto& r : m_references) {
+        if(r.position > position) {
+            iov.push_back({m_packet + position, r.position - position});
+        }
+
+        if(r.packet->getPayloadLength() > 0) {
+            iov.push_back({r.packet->getPayload(), r.packet->getPayloadLength()});
+        }
+
+        position = r.position;
+    }
+
+    if(m_usage > position) {
+        iov.push_back({m_packet + position, m_usage - position});
+    }
+
+    size_t index = 0;
+
+    while(index < iov.size()) {
+        if(pollfd(fd, timeout_ms, false) == 0) {
+            return false;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov[index];
+        msg.msg_iovlen = std::min<size_t>(iov.size() - index, IOV_MAX);
+
+        ssize_t rc = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if(rc == -1 && sockerror() == ENOTSOCK) {
+            rc = ::writev(fd, msg.msg_iov, msg.msg_iovlen);
+        }
+
+        if(rc == -1 || rc == 0) {
+            if(sockerror() == SEWOULDBLOCK) {
+                continue;
+            }
+
+            return false;
+        }
+
+        // skip the data already sent
+        while(index < iov.size() && (size_t)rc >= iov[index].iov_len) {
+            rc -= iov[index].iov_len;
+            index++;
+        }
+
+        if(index < iov.size()) {
+            iov[index].iov_base = (uint8_t*)iov[index].iov_base + rc;
+            iov[index].iov_len -= rc;
+        }
+    }
+
+    return true;
+#endif
+}
+
 MsgPacket* MsgPacket::read(int fd, int timeout_ms) {
     bool bClosed;
     return read(fd, bClosed, timeout_ms);
@@ -614,7 +714,7 @@ bool MsgPacket::compress(int level) {
     return false;
 #else
 
-    if(level <= 0 || level > 9 || m_freezed) {
+    if(level <= 0 || level > 9 || m_freezed || !m_references.empty()) {
         return false;
     }
 
@@ -10,6 +10,8 @@
 #include <pthread.h>
 #include <string.h>
 #include <string>
+#include <vector>
+#include <memory>
 
 #include <ostream>
 #include <istream>
@@ -150,6 +152,17 @@ public:
     */
     bool put_Blob(uint8_t source[], uint32_t length);
 
+    /**
+    Insert a reference to the payload of another packet.
+    Adds the payload of a packet without copying it. The referenced data is
+    sent by write() (scatter / gather), but it isn't accessible with the
+    "get_" functions and isn't part of getPayloadLength().
+
+    @param	packet		packet holding the data
+    @return true on success / false on memory allocation error
+    */
+    bool put_Ref(const std::shared_ptr<MsgPacket>& packet);
+
     /**
     Reserve space.
     Creates a memory region in the payload of the packet.
@@ -492,9 +505,10 @@ protected:
 
     @param  buf		pointer to data array
     @param  size    size of array in bytes
+    @param  crc     crc of the preceding data (to continue a checksum)
     @return 32bit crc
     */
-    static uint32_t crc32(const uint8_t* buf, int size);
+    static uint32_t crc32(const uint8_t* buf, int size, uint32_t crc = 0);
 
     static int read(int fd, uint8_t* data, int datalen, int timeout_ms);
 
@@ -514,6 +528,13 @@ private:
 
     bool checkPacketSize(uint32_t bytes);
 
+    bool writeVector(int fd, int timeout_ms);
+
+    struct Reference {
+        uint32_t position;
+        std::shared_ptr<MsgPacket> packet;
+    };
+
     static uint32_t globalUID;
     static uint32_t crc32_tab[];
 
@@ -525,6 +546,9 @@ private:
     bool m_freezed;
     bool m_payloadchecksum;
 
+    std::vector<Reference> m_references;
+    uint32_t m_referenceLength = 0;
+
     enum {
         InitialPacketSize = 128,
         IncrementPacketSize = 512
@@ -26,8 +26,6 @@
 #include <tools/time.h>
 #include "packetplayer.h"
 
-#define MIN_PACKET_SIZE (128 * 1024)
-
 PacketPlayer::PacketPlayer(const cRecording* rec) : RecPlayer(rec->FileName()) {
     m_index = new cIndexFile(rec->FileName(), false);
     m_recording = rec;
@@ -144,6 +142,12 @@ MsgPacket* PacketPlayer::requestPacket() {
     if(m_streamPacket == nullptr) {
         m_streamPacket = new MsgPacket();
         m_streamPacket->disablePayloadCheckSum();
+
+        // average bitrate of the recording
+        int64_t durationMs = m_recording->LengthInSeconds() * 1000;
+
+        m_aggregator.reset();
+        m_aggregator.setBitRate(durationMs > 0 ? m_totalLength * 1000 / durationMs : 0);
     }
 
     while((p = getPacket()) != nullptr) {
@@ -158,21 +162,26 @@ MsgPacket* PacketPlayer::requestPacket() {
         m_streamPacket->put_U16(p->getMsgID());
         m_streamPacket->put_U16(p->getClientID());
 
-        // add payload
-        uint8_t* data = p->getPayload();
+        // add payload (the stream packet takes over the packet)
         uint32_t length = p->getPayloadLength();
-        m_streamPacket->put_Blob(data, length);
-
-        delete p;
+        m_streamPacket->put_Ref(std::shared_ptr<MsgPacket>(p));
+        m_aggregator.add(length + 4);
 
         // send payload packet if it's big enough
-        if(m_streamPacket->getPayloadLength() >= MIN_PACKET_SIZE) {
+        if(m_aggregator.ready()) {
             MsgPacket* result = m_streamPacket;
             m_streamPacket = nullptr;
             return result;
         }
     }
 
+    // end of the (running) recording -> send pending data after the deadline
+    if(m_aggregator.ready()) {
+        MsgPacket* result = m_streamPacket;
+        m_streamPacket = nullptr;
+        return result;
+    }
+
     dsyslog("PacketPlayer: requestPacket didn't get any packet !");
     return nullptr;
 }
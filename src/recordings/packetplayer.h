@@ -29,6 +29,7 @@
 #include "robotvdmx/demuxerbundle.h"
 
 #include "robotv/StreamPacketProcessor.h"
+#include "robotv/StreamPacketAggregator.h"
 #include "recordings/recplayer.h"
 #include "net/msgpacket.h"
 
@@ -83,6 +84,8 @@ private:
 
     MsgPacket* m_streamPacket = NULL;
 
+    StreamPacketAggregator m_aggregator;
+
     std::chrono::milliseconds m_startTime;
 
     std::chrono::milliseconds m_endTime;
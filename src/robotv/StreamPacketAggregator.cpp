@@ -0,0 +1,115 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <algorithm>
+#include <vdr/tools.h>
+#include "StreamPacketAggregator.h"
+
+using namespace std::chrono;
+
+milliseconds StreamPacketAggregator::m_defaultLatency(500);
+
+uint32_t StreamPacketAggregator::m_minPacketSize = 16 * 1024;
+
+uint32_t StreamPacketAggregator::m_maxPacketSize = 1024 * 1024;
+
+StreamPacketAggregator::StreamPacketAggregator() : m_latency(m_defaultLatency), m_bitRate(0), m_length(0), m_count(0) {
+}
+
+void StreamPacketAggregator::setLatency(milliseconds latency) {
+    m_latency = (latency.count() > 0) ? latency : m_defaultLatency;
+}
+
+void StreamPacketAggregator::setBitRate(uint64_t bitRate) {
+    m_bitRate = bitRate;
+}
+
+void StreamPacketAggregator::reset() {
+    m_length = 0;
+    m_count = 0;
+}
+
+void StreamPacketAggregator::add(uint32_t length) {
+    if(m_count++ == 0) {
+        m_start = steady_clock::now();
+    }
+
+    m_length += length;
+}
+
+bool StreamPacketAggregator::ready() const {
+    if(m_count == 0) {
+        return false;
+    }
+
+    if(m_length >= targetSize()) {
+        return true;
+    }
+
+    return (steady_clock::now() - m_start >= m_latency);
+}
+
+milliseconds StreamPacketAggregator::timeLeft() const {
+    if(m_count == 0) {
+        return m_latency;
+    }
+
+    auto elapsed = duration_cast<milliseconds>(steady_clock::now() - m_start);
+    return std::max(milliseconds(0), m_latency - elapsed);
+}
+
+uint32_t StreamPacketAggregator::targetSize() const {
+    if(m_bitRate == 0) {
+        return m_minPacketSize;
+    }
+
+    // data of the stream within the target latency
+    uint64_t size = m_bitRate * m_latency.count() / 1000;
+    return (uint32_t)std::min<uint64_t>(std::max<uint64_t>(size, m_minPacketSize), m_maxPacketSize);
+}
+
+void StreamPacketAggregator::setDefaultLatency(int ms) {
+    m_defaultLatency = milliseconds(std::max(ms, 1));
+    isyslog("stream latency: %i ms", ms);
+}
+
+void StreamPacketAggregator::setMinPacketSize(uint32_t size) {
+    m_minPacketSize = size;
+    isyslog("stream packet min size: %u bytes", size);
+}
+
+void StreamPacketAggregator::setMaxPacketSize(uint32_t size) {
+    m_maxPacketSize = size;
+    isyslog("stream packet max size: %u bytes", size);
+}
+
+void StreamPacketAggregator::checkPacketSizes() {
+    if(m_maxPacketSize >= m_minPacketSize) {
+        return;
+    }
+
+    esyslog("stream packet max size below min size - using %u bytes", m_minPacketSize);
+    m_maxPacketSize = m_minPacketSize;
+}
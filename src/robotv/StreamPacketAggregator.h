@@ -0,0 +1,122 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_STREAMPACKETAGGREGATOR_H
+#define ROBOTV_STREAMPACKETAGGREGATOR_H
+
+#include <stdint.h>
+#include <chrono>
+
+/**
+ * Aggregation of stream data into network packets.
+ * Data is collected until the amount of data the stream produces within the
+ * target latency has been reached (limited by the minimum and maximum packet
+ * size), or until the oldest data has been held back for the target latency.
+ */
+class StreamPacketAggregator {
+public:
+
+    StreamPacketAggregator();
+
+    /**
+     * Set the target latency.
+     * @param latency maximum time data is held back (0 = configured default)
+     */
+    void setLatency(std::chrono::milliseconds latency);
+
+    /**
+     * Set the bitrate of the stream.
+     * @param bitRate bitrate in bytes/s (0 = unknown)
+     */
+    void setBitRate(uint64_t bitRate);
+
+    /**
+     * Start a new packet.
+     */
+    void reset();
+
+    /**
+     * Account data added to the current packet.
+     * @param length number of bytes added
+     */
+    void add(uint32_t length);
+
+    /**
+     * Check if the current packet should be sent.
+     * @return true if the packet reached its target size or the latency deadline
+     */
+    bool ready() const;
+
+    /**
+     * Check if the current packet doesn't contain any data.
+     */
+    bool empty() const {
+        return m_count == 0;
+    }
+
+    /**
+     * Get the time until the latency deadline of the current packet.
+     * @return remaining time (the target latency if the packet is empty)
+     */
+    std::chrono::milliseconds timeLeft() const;
+
+    /**
+     * Get the target size of a packet.
+     * @return packet size in bytes
+     */
+    uint32_t targetSize() const;
+
+    static void setDefaultLatency(int ms);
+
+    static void setMinPacketSize(uint32_t size);
+
+    static void setMaxPacketSize(uint32_t size);
+
+    /**
+     * Make sure the maximum packet size isn't below the minimum size.
+     * Called once after all settings have been loaded.
+     */
+    static void checkPacketSizes();
+
+private:
+
+    std::chrono::milliseconds m_latency;
+
+    uint64_t m_bitRate;
+
+    uint32_t m_length;
+
+    int m_count;
+
+    std::chrono::steady_clock::time_point m_start;
+
+    static std::chrono::milliseconds m_defaultLatency;
+
+    static uint32_t m_minPacketSize;
+
+    static uint32_t m_maxPacketSize;
+};
+
+#endif // ROBOTV_STREAMPACKETAGGREGATOR_H
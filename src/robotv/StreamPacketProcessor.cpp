@@ -214,12 +214,28 @@ void StreamPacketProcessor::onStreamChange() {
 }
 
 MsgPacket *StreamPacketProcessor::createStreamChangePacket(DemuxerBundle &bundle) {
+    return createStreamChangePacket(bundle, std::set<int>());
+}
+
+MsgPacket *StreamPacketProcessor::createStreamChangePacket(DemuxerBundle &bundle, const std::set<int>& pids) {
     MsgPacket* resp = new MsgPacket(ROBOTV_STREAM_CHANGE, ROBOTV_CHANNEL_STREAM);
 
-    resp->put_U8((uint8_t)bundle.size());
+    uint8_t count = 0;
+
+    for(auto stream: bundle) {
+        if(pids.empty() || pids.count(stream->getPid()) > 0) {
+            count++;
+        }
+    }
+
+    resp->put_U8(count);
 
     for(auto stream: bundle) {
         int streamId = stream->getPid();
+
+        if(!pids.empty() && pids.count(streamId) == 0) {
+            continue;
+        }
         resp->put_U32((uint32_t)streamId);
 
         switch(stream->getContent()) {
@@ -31,6 +31,7 @@
 #include <net/msgpacket.h>
 #include <vdr/remux.h>
 #include <deque>
+#include <set>
 
 class StreamPacketProcessor : protected TsDemuxer::Listener {
 public:
@@ -86,6 +87,14 @@ protected:
 
     virtual MsgPacket* createStreamChangePacket(DemuxerBundle& bundle);
 
+    /**
+     * Create stream information for a subset of the streams.
+     * @param bundle demuxers of the stream
+     * @param pids pids of the streams to include (empty for all streams)
+     * @return stream change packet
+     */
+    MsgPacket* createStreamChangePacket(DemuxerBundle& bundle, const std::set<int>& pids);
+
     inline DemuxerBundle& getDemuxers() {
         return m_demuxers;
     }
@@ -61,6 +61,12 @@ MsgPacket* StreamController::process(MsgPacket* request) {
 
         case ROBOTV_CHANNELSTREAM_SEEK:
             return processSeek(request);
+
+        case ROBOTV_CHANNELSTREAM_TRICKPLAY:
+            return processTrickPlay(request);
+
+        case ROBOTV_CHANNELSTREAM_SELECTSTREAMS:
+            return processSelectStreams(request);
     }
 
     return nullptr;
@@ -84,6 +90,25 @@ MsgPacket* StreamController::processOpen(MsgPacket* request) {
         m_langStreamType = (StreamInfo::Type)request->get_U8();
     }
 
+    // push mode and stream latency in ms (protocol version 10)
+    bool push = false;
+    int32_t latency = 0;
+
+    if(request->getProtocolVersion() >= 10 && !request->eop()) {
+        push = request->get_U8();
+    }
+
+    if(request->getProtocolVersion() >= 10 && !request->eop()) {
+        latency = request->get_S32();
+    }
+
+    // selected streams (protocol version 11)
+    std::set<int> pids;
+
+    if(request->getProtocolVersion() >= 11 && !request->eop()) {
+        pids = getStreamPids(request);
+    }
+
     if(m_langStreamType == StreamInfo::Type::NONE) {
         m_langStreamType = StreamInfo::Type::AC3;
     }
@@ -113,11 +138,14 @@ MsgPacket* StreamController::processOpen(MsgPacket* request) {
 
     status = startStreaming(
             channel,
-            priority);
+            priority,
+            push,
+            latency,
+            pids);
 
     if(status == ROBOTV_RET_OK) {
         isyslog("--------------------------------------");
-        isyslog("Started streaming of channel %s (priority %i)", channel->Name(), priority);
+        isyslog("Started streaming of channel %s (priority %i%s)", channel->Name(), priority, push ? ", push mode" : "");
     }
     else {
         time_t now = time(nullptr);
@@ -145,6 +173,11 @@ MsgPacket* StreamController::processRequest(MsgPacket* request) {
         return nullptr;
     }
 
+    // packets are pushed to the client
+    if(m_streamer->isPushing()) {
+        return createResponse(request);
+    }
+
     MsgPacket* p = nullptr;
 
     int64_t start = roboTV::currentTimeMillis().count();
@@ -192,13 +225,21 @@ void StreamController::processChannelChange(const cChannel* Channel) {
     }
 }
 
-int StreamController::startStreaming(const cChannel* channel, int32_t priority) {
+int StreamController::startStreaming(const cChannel* channel, int32_t priority, bool push, int32_t latency, const std::set<int>& pids) {
     std::lock_guard<std::mutex> lock(m_lock);
 
     m_streamer = new LiveStreamer(m_parent, priority);
     m_streamer->setLanguage(m_language.c_str(), m_langStreamType);
+    m_streamer->setLatency(std::chrono::milliseconds(latency));
+    m_streamer->setStreams(pids);
 
-    return m_streamer->switchChannel(channel);
+    int status = m_streamer->switchChannel(channel);
+
+    if(status == ROBOTV_RET_OK && push) {
+        m_streamer->startPushing();
+    }
+
+    return status;
 }
 
 void StreamController::stopStreaming() {
@@ -222,3 +263,53 @@ MsgPacket* StreamController::processSeek(MsgPacket* request) {
     response->put_S64(pts);
     return response;
 }
+
+MsgPacket* StreamController::processTrickPlay(MsgPacket* request) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if(m_streamer == nullptr) {
+        return nullptr;
+    }
+
+    int32_t rate = request->get_S32();
+    int64_t pts = m_streamer->trickPlay(rate);
+
+    MsgPacket* response = createResponse(request);
+    response->put_S64(pts);
+    return response;
+}
+
+MsgPacket* StreamController::processSelectStreams(MsgPacket* request) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if(m_streamer == nullptr) {
+        return nullptr;
+    }
+
+    std::set<int> pids = getStreamPids(request);
+    int status = ROBOTV_RET_DATAINVALID;
+
+    {
+        LOCK_CHANNELS_READ;
+        const cChannel* channel = findChannelByUid(Channels, m_streamer->getChannelUid());
+
+        if(channel != nullptr) {
+            status = m_streamer->selectStreams(channel, pids);
+        }
+    }
+
+    MsgPacket* response = createResponse(request);
+    response->put_U32(status);
+    return response;
+}
+
+std::set<int> StreamController::getStreamPids(MsgPacket* request) {
+    std::set<int> pids;
+    int count = request->get_U8();
+
+    for(int i = 0; i < count && !request->eop(); i++) {
+        pids.insert((int)request->get_U32());
+    }
+
+    return pids;
+}
@@ -26,6 +26,7 @@
 #define	ROBOTV_STREAMCONTROLLER_H
 
 #include <mutex>
+#include <set>
 
 #include "live/livestreamer.h"
 #include "controller.h"
@@ -44,6 +45,8 @@ public:
 
     void processChannelChange(const cChannel* Channel);
 
+    void stopStreaming();
+
 protected:
 
     MsgPacket* processOpen(MsgPacket* request);
@@ -58,13 +61,20 @@ protected:
 
     MsgPacket* processSeek(MsgPacket* request);
 
+    MsgPacket* processTrickPlay(MsgPacket* request);
+
+    MsgPacket* processSelectStreams(MsgPacket* request);
+
 private:
 
     StreamController(const StreamController& orig);
 
-    int startStreaming(const cChannel* channel, int32_t priority);
+    int startStreaming(const cChannel* channel, int32_t priority, bool push, int32_t latency, const std::set<int>& pids);
 
-    void stopStreaming();
+    /**
+     * Read a list of stream pids (U8 count, U32 pids).
+     */
+    static std::set<int> getStreamPids(MsgPacket* request);
 
     std::string m_language;
 
@@ -25,6 +25,8 @@
 #include <getopt.h>
 #include <vdr/plugin.h>
 #include "robotv.h"
+#include "live/livequeue.h"
+#include "live/pretuner.h"
 
 PluginRoboTVServer::PluginRoboTVServer(void) {
     m_server = NULL;
@@ -66,7 +68,9 @@ bool PluginRoboTVServer::Initialize(void) {
 }
 
 bool PluginRoboTVServer::Start(void) {
+    LiveQueue::createFilePool();
     m_server = new RoboTVServer(RoboTVServerConfig::instance().listenPort);
+    PreTuner::instance().start();
 
     return true;
 }
@@ -74,6 +78,9 @@ bool PluginRoboTVServer::Start(void) {
 void PluginRoboTVServer::Stop(void) {
     delete m_server;
     m_server = NULL;
+
+    PreTuner::instance().stop();
+    LiveQueue::destroyFilePool();
 }
 
 void PluginRoboTVServer::Housekeeping(void) {
@@ -61,6 +61,9 @@ RoboTvClient::~RoboTvClient() {
     shutdown(m_socket, SHUT_RDWR);
     Cancel(10);
 
+    // stop the streaming threads before the socket can be reused
+    m_streamController.stopStreaming();
+
     // close connection
     close(m_socket);
 
@@ -84,19 +87,36 @@ void RoboTvClient::Action(void) {
     while(Running()) {
 
         // send pending messages
-        {
-            std::lock_guard<std::mutex> lock(m_queueLock);
+        // (unless the streaming thread is writing right now)
+        std::unique_lock<std::mutex> lockWrite(m_writeLock, std::try_to_lock);
+
+        while(lockWrite.owns_lock()) {
+            MsgPacket* p = nullptr;
 
-            while(!m_queue.empty()) {
-                MsgPacket* p = m_queue.front();
+            {
+                std::lock_guard<std::mutex> lock(m_queueLock);
 
-                if(!p->write(m_socket, m_timeout)) {
+                if(m_queue.empty()) {
                     break;
                 }
 
+                p = m_queue.front();
+            }
+
+            if(!p->write(m_socket, m_timeout)) {
+                break;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_queueLock);
                 m_queue.pop_front();
-                delete p;
             }
+
+            delete p;
+        }
+
+        if(lockWrite.owns_lock()) {
+            lockWrite.unlock();
         }
 
         m_request = MsgPacket::read(m_socket, bClosed, 10);
@@ -242,3 +262,32 @@ void RoboTvClient::queueMessage(MsgPacket* p) {
     std::lock_guard<std::mutex> lock(m_queueLock);
     m_queue.push_back(p);
 }
+
+void RoboTvClient::sendMessage(MsgPacket* p) {
+    std::lock_guard<std::mutex> lockWrite(m_writeLock);
+
+    if(m_writeError) {
+        delete p;
+        return;
+    }
+
+    // keep the order of queued messages
+    {
+        std::lock_guard<std::mutex> lock(m_queueLock);
+
+        if(!m_queue.empty()) {
+            m_queue.push_back(p);
+            return;
+        }
+    }
+
+    // write without holding the queue lock
+    // (a partially sent packet can't be sent again, drop the connection)
+    if(!p->write(m_socket, m_timeout)) {
+        esyslog("failed to send message to client %u - closing connection", m_id);
+        m_writeError = true;
+        shutdown(m_socket, SHUT_RDWR);
+    }
+
+    delete p;
+}
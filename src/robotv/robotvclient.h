@@ -69,6 +69,12 @@ private:
 
     std::mutex m_queueLock;
 
+    // serializes writes to the socket
+    std::mutex m_writeLock;
+
+    // a message has been sent partially (protected by m_writeLock)
+    bool m_writeError = false;
+
     // Controllers
 
     StreamController m_streamController;
@@ -110,6 +116,14 @@ public:
 
     void queueMessage(MsgPacket* p);
 
+    /**
+     * Send a message without waiting for the client thread.
+     * Falls back to the message queue if messages are pending. The
+     * connection is closed if the message can't be sent.
+     * @param p message (ownership is taken over)
+     */
+    void sendMessage(MsgPacket* p);
+
     void sendStatusMessage(const char* Message);
 
     unsigned int getId() const {
@@ -26,7 +26,7 @@
 #define ROBOTV_COMMAND_H
 
 /** Current RoboTV Protocol Version number */
-#define ROBOTV_PROTOCOLVERSION          8
+#define ROBOTV_PROTOCOLVERSION          11
 
 
 /** Packet types */
@@ -53,6 +53,8 @@
 #define ROBOTV_CHANNELSTREAM_PAUSE   23
 #define ROBOTV_CHANNELSTREAM_SIGNAL  24
 #define ROBOTV_CHANNELSTREAM_SEEK    25
+#define ROBOTV_CHANNELSTREAM_TRICKPLAY 26      /* protocol version 9 */
+#define ROBOTV_CHANNELSTREAM_SELECTSTREAMS 27  /* protocol version 11 */
 
 /* OPCODE 40 - 59: RoboTV network functions for recording streaming */
 #define ROBOTV_RECSTREAM_OPEN        40
@@ -113,6 +115,7 @@
 #define ROBOTV_STREAM_SIGNALINFO   5
 #define ROBOTV_STREAM_DETACH       7
 #define ROBOTV_STREAM_POSITIONS    8
+#define ROBOTV_STREAM_PACKET       9
 
 /** Stream status codes */
 #define ROBOTV_STREAM_STATUS_SIGNALLOST     111
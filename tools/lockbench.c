@@ -0,0 +1,271 @@
+/*
+ *      RoboTV Timeshift Lock Contention Benchmark
+ *
+ *      Copyright (C) 2015 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+// Measures how long readers of a timeshift queue wait for the queue lock
+// while the writer thread stores records:
+//
+//   locked   - the writer holds the lock during pwritev() and fdatasync()
+//              (previous writer)
+//   unlocked - the writer holds the lock only to stage and publish the
+//              records, the disk write runs unlocked (current writer)
+//
+// The writer wakes up every wakeup interval and writes the records produced
+// at the given bitrate. Every reader polls the write position once per
+// millisecond, like a client waiting for data.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+static std::string filename = "/tmp/robotv-lockbench.data";
+static uint64_t bitRate = 20000000;
+static int seconds = 10;
+static size_t recordSize = 1316;
+static int wakeupMs = 10;
+static int readerCount = 4;
+static bool dataSync = true;
+
+// latencies in microseconds
+struct Latency {
+	std::vector<int64_t> samples;
+
+	void add(Clock::time_point start, Clock::time_point end) {
+		samples.push_back(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+	}
+
+	void merge(const Latency& l) {
+		samples.insert(samples.end(), l.samples.begin(), l.samples.end());
+	}
+
+	void report(const char* name) {
+		if(samples.empty()) {
+			return;
+		}
+
+		std::sort(samples.begin(), samples.end());
+
+		int64_t sum = 0;
+
+		for(int64_t s : samples) {
+			sum += s;
+		}
+
+		printf("  %-16s %10lu samples  avg %8li us  p99 %8li us  max %8li us\n",
+		       name,
+		       samples.size(),
+		       (long)(sum / (int64_t)samples.size()),
+		       (long)samples[samples.size() * 99 / 100],
+		       (long)samples.back());
+	}
+};
+
+static bool run(bool locked) {
+	int fd = open(filename.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+
+	if(fd == -1) {
+		std::cerr << "Unable to open : " << filename << std::endl;
+		return false;
+	}
+
+	std::vector<uint8_t> record(recordSize, 0x47);
+	std::vector<struct iovec> iov;
+
+	std::mutex mutex;
+	off_t writePosition = 0;
+	std::atomic<bool> running(true);
+	bool rc = true;
+
+	Latency lockHold;
+	std::vector<Latency> readerWait(readerCount);
+	std::vector<std::thread> readers;
+
+	for(int i = 0; i < readerCount; i++) {
+		readers.emplace_back([&, i]() {
+			off_t position = 0;
+
+			while(running) {
+				auto start = Clock::now();
+
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					readerWait[i].add(start, Clock::now());
+					position = writePosition;
+				}
+
+				(void)position;
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		});
+	}
+
+	auto start = Clock::now();
+	auto end = start + std::chrono::seconds(seconds);
+	uint64_t written = 0;
+	off_t position = 0;
+
+	while(rc && Clock::now() < end) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(wakeupMs));
+
+		double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		uint64_t due = (uint64_t)(elapsed * bitRate / 8 / recordSize);
+		size_t count = std::min<uint64_t>(due - written, IOV_MAX);
+
+		if(count == 0) {
+			continue;
+		}
+
+		// stage the records
+		std::unique_lock<std::mutex> lock(mutex);
+		auto lockTime = Clock::now();
+
+		iov.assign(count, {(void*)record.data(), record.size()});
+		ssize_t length = count * record.size();
+
+		if(!locked) {
+			lockHold.add(lockTime, Clock::now());
+			lock.unlock();
+		}
+
+		// write (and sync) the records
+		rc = (pwritev(fd, iov.data(), count, position) == length);
+
+		if(rc && dataSync) {
+			fdatasync(fd);
+		}
+
+		// publish the records
+		if(!locked) {
+			lock.lock();
+			lockTime = Clock::now();
+		}
+
+		position += length;
+		writePosition = position;
+		written += count;
+
+		lockHold.add(lockTime, Clock::now());
+	}
+
+	running = false;
+
+	for(auto& t : readers) {
+		t.join();
+	}
+
+	close(fd);
+	unlink(filename.c_str());
+
+	if(!rc) {
+		std::cerr << "write failed: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	Latency readerLatency;
+
+	for(const auto& l : readerWait) {
+		readerLatency.merge(l);
+	}
+
+	printf("%s: %lu records written\n", locked ? "locked" : "unlocked", written);
+	lockHold.report("writer lock hold");
+	readerLatency.report("reader lock wait");
+
+	return true;
+}
+
+static void usage() {
+	std::cerr << "usage: lockbench [-f file] [-r bitrate] [-t seconds] [-s recordsize] [-w wakeup ms] [-c readers] [-n]" << std::endl;
+	std::cerr << "  -n skips the fdatasync() after every wakeup" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	int c;
+
+	while((c = getopt(argc, argv, "f:r:t:s:w:c:nh")) != -1) {
+		switch(c) {
+			case 'f':
+				filename = optarg;
+				break;
+
+			case 'r':
+				bitRate = strtoull(optarg, NULL, 10);
+				break;
+
+			case 't':
+				seconds = atoi(optarg);
+				break;
+
+			case 's':
+				recordSize = strtoul(optarg, NULL, 10);
+				break;
+
+			case 'w':
+				wakeupMs = atoi(optarg);
+				break;
+
+			case 'c':
+				readerCount = atoi(optarg);
+				break;
+
+			case 'n':
+				dataSync = false;
+				break;
+
+			default:
+				usage();
+				return 1;
+		}
+	}
+
+	if(bitRate == 0 || seconds <= 0 || wakeupMs <= 0 || recordSize == 0 || readerCount < 0) {
+		usage();
+		return 1;
+	}
+
+	printf("%lu bit/s, %lu byte records, %i ms wakeups, %i readers, %i s\n", bitRate, recordSize, wakeupMs, readerCount, seconds);
+
+	if(!run(true) || !run(false)) {
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,259 @@
+/*
+ *      RoboTV Timeshift Write Benchmark
+ *
+ *      Copyright (C) 2015 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+// Compares the two ways the timeshift writer stores queued records:
+//
+//   single   - one lseek() + write() per record (previous writer)
+//   vectored - one pwritev() per writer wakeup (current writer)
+//
+// Records are produced at a constant bitrate and written every wakeup
+// interval, like the packets the demuxer queues for the writer thread.
+// With a bitrate of 0 all records are written as fast as possible.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+// record header of the timeshift file (see TimeShiftRecord)
+struct Header {
+	uint32_t length;
+	uint16_t msgId;
+	uint16_t clientId;
+};
+
+static std::string filename = "/tmp/robotv-writebench.data";
+static uint64_t bitRate = 20000000;
+static int seconds = 10;
+static size_t recordSize = 1316;
+static int wakeupMs = 10;
+static bool dataSync = false;
+
+struct Result {
+	uint64_t records = 0;
+	uint64_t bytes = 0;
+	uint64_t syscalls = 0;
+	double wallTime = 0;
+	double cpuTime = 0;
+};
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpuTime() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+	       usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static bool writeSingle(int fd, off_t& position, const std::vector<uint8_t>& record, size_t count, Result& result) {
+	for(size_t i = 0; i < count; i++) {
+		if(lseek(fd, position, SEEK_SET) == (off_t)-1) {
+			return false;
+		}
+
+		if(write(fd, record.data(), record.size()) != (ssize_t)record.size()) {
+			return false;
+		}
+
+		result.syscalls += 2;
+		position += record.size();
+	}
+
+	return true;
+}
+
+static bool writeVectored(int fd, off_t& position, const std::vector<uint8_t>& record, size_t count, Result& result) {
+	std::vector<struct iovec> iov;
+
+	while(count > 0) {
+		size_t n = std::min(count, (size_t)IOV_MAX);
+		iov.assign(n, {(void*)record.data(), record.size()});
+
+		ssize_t length = n * record.size();
+
+		if(pwritev(fd, iov.data(), n, position) != length) {
+			return false;
+		}
+
+		result.syscalls++;
+		position += length;
+		count -= n;
+	}
+
+	return true;
+}
+
+static bool run(bool vectored, Result& result) {
+	int fd = open(filename.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+
+	if(fd == -1) {
+		std::cerr << "Unable to open : " << filename << std::endl;
+		return false;
+	}
+
+	// record with header and payload
+	std::vector<uint8_t> record(recordSize, 0x47);
+	Header* header = (Header*)record.data();
+	header->length = recordSize - sizeof(Header);
+	header->msgId = 1;
+	header->clientId = 0;
+
+	uint64_t total = (uint64_t)seconds * bitRate / 8 / recordSize;
+
+	if(bitRate == 0) {
+		total = (uint64_t)seconds * 20000000 / 8 / recordSize;
+	}
+
+	off_t position = 0;
+	double start = now();
+	double cpuStart = cpuTime();
+	bool rc = true;
+
+	while(rc && result.records < total) {
+		size_t count = total - result.records;
+
+		// records produced since the start
+		if(bitRate > 0) {
+			struct timespec ts = {0, wakeupMs * 1000000L};
+			nanosleep(&ts, NULL);
+
+			uint64_t due = (uint64_t)((now() - start) * bitRate / 8 / recordSize);
+			count = std::min(due, total) - result.records;
+		}
+
+		rc = vectored ? writeVectored(fd, position, record, count, result) : writeSingle(fd, position, record, count, result);
+
+		if(rc && dataSync) {
+			fdatasync(fd);
+			result.syscalls++;
+		}
+
+		result.records += count;
+	}
+
+	result.wallTime = now() - start;
+	result.cpuTime = cpuTime() - cpuStart;
+	result.bytes = position;
+
+	close(fd);
+	unlink(filename.c_str());
+
+	if(!rc) {
+		std::cerr << "write failed: " << strerror(errno) << std::endl;
+	}
+
+	return rc;
+}
+
+static void report(const char* name, const Result& result) {
+	printf("%-8s %10lu records %8.1f MB %10lu syscalls %10.0f syscalls/s %8.3f s cpu %6.2f %% cpu %8.1f MB/s\n",
+	       name,
+	       result.records,
+	       result.bytes / 1e6,
+	       result.syscalls,
+	       result.syscalls / result.wallTime,
+	       result.cpuTime,
+	       result.cpuTime * 100 / result.wallTime,
+	       result.bytes / 1e6 / result.wallTime);
+}
+
+static void usage() {
+	std::cerr << "usage: writebench [-f file] [-r bitrate] [-t seconds] [-s recordsize] [-w wakeup ms] [-d]" << std::endl;
+	std::cerr << "  -r 0 writes the records of 20 Mbit/s for the given time as fast as possible" << std::endl;
+	std::cerr << "  -d calls fdatasync() after every wakeup" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	int c;
+
+	while((c = getopt(argc, argv, "f:r:t:s:w:dh")) != -1) {
+		switch(c) {
+			case 'f':
+				filename = optarg;
+				break;
+
+			case 'r':
+				bitRate = strtoull(optarg, NULL, 10);
+				break;
+
+			case 't':
+				seconds = atoi(optarg);
+				break;
+
+			case 's':
+				recordSize = strtoul(optarg, NULL, 10);
+				break;
+
+			case 'w':
+				wakeupMs = atoi(optarg);
+				break;
+
+			case 'd':
+				dataSync = true;
+				break;
+
+			default:
+				usage();
+				return 1;
+		}
+	}
+
+	if(seconds <= 0 || wakeupMs <= 0 || recordSize <= sizeof(Header)) {
+		usage();
+		return 1;
+	}
+
+	printf("%lu bit/s, %lu byte records, %i ms wakeups, %i s\n", bitRate, recordSize, wakeupMs, seconds);
+
+	Result single;
+	Result vectored;
+
+	if(!run(false, single) || !run(true, vectored)) {
+		return 1;
+	}
+
+	report("single", single);
+	report("vectored", vectored);
+
+	return 0;
+}